@@ -38,7 +38,12 @@
 #   define HAVE_STDATOMIC_H 1
 #endif /* defined(HAVE_STDC_VERSION_201112) ... */
 
+/*
+ *  Define C11_FORCE_THREADS_WORKAROUND to use the workaround even
+ *  where <threads.h> is available (e.g. glibc 2.28 and higher).
+ */
 #if defined(HAVE_STDC_VERSION_201112) && !defined(__STDC_NO_THREADS__) \
+    && !defined(C11_FORCE_THREADS_WORKAROUND) \
     && !defined(__MINGW32__) \
     && !(defined(__INTEL_COMPILER) && defined(_MSC_VER)) \
     && !(defined(__clang__) && defined(_MSC_VER))
@@ -0,0 +1,219 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include <c11/epoch.h>
+
+#include <c11/aligned_alloc.h>
+
+static size_t free_nodes(struct epoch_node* node)
+{
+    size_t count = 0;
+    while (node)
+    {
+        struct epoch_node* next = node->next;
+        node->free(node);
+        node = next;
+        ++count;
+    }
+    return count;
+}
+
+/*
+ *  A node retired in epoch e can still be referenced by threads
+ *  that entered in e (or e - 2), and those may be inside while
+ *  the epoch is e + 2. Once it is e + 4 every thread inside has
+ *  entered after the node was unlinked.
+ */
+
+static inline int expired(unsigned int epoch, unsigned int tag)
+{
+    return epoch - tag >= 4;
+}
+
+static void release_record(void* arg)
+{
+    struct epoch_record* record = arg;
+    record->nesting = 0;
+    atomic_store_explicit(&record->state, 0, memory_order_relaxed);
+    atomic_store_explicit(&record->in_use, 0, memory_order_release);
+}
+
+void epoch_destroy(epoch_t* domain)
+{
+    tss_delete(domain->key);
+    struct epoch_record* record = atomic_load_explicit(&domain->records
+        , memory_order_acquire);
+    while (record)
+    {
+        struct epoch_record* next = record->next;
+        for (int i = 0; i < 3; ++i)
+            free_nodes(record->limbo[i].head);
+        aligned_free(record);
+        record = next;
+    }
+}
+
+int epoch_init(epoch_t* domain)
+{
+    if (tss_create(&domain->key, release_record) != thrd_success)
+        return thrd_error;
+    atomic_init(&domain->epoch, 0);
+    atomic_init(&domain->records, NULL);
+    return thrd_success;
+}
+
+static struct epoch_record* acquire_record(epoch_t* domain)
+{
+    struct epoch_record* record = atomic_load_explicit(&domain->records
+        , memory_order_acquire);
+    for (; record; record = record->next)
+    {
+        unsigned int expected = 0;
+        if (atomic_load_explicit(&record->in_use, memory_order_relaxed) == 0
+            && atomic_compare_exchange_strong_explicit(&record->in_use
+                , &expected, 1, memory_order_acquire, memory_order_relaxed))
+            return record;
+    }
+    record = aligned_alloc(CACHELINE_SIZE, sizeof(struct epoch_record));
+    if (record == NULL)
+        return NULL;
+    atomic_init(&record->state, 0);
+    record->nesting = 0;
+    atomic_init(&record->in_use, 1);
+    record->domain = domain;
+    record->pending = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        record->limbo[i].head = NULL;
+        record->limbo[i].epoch = 0;
+    }
+    struct epoch_record* head = atomic_load_explicit(&domain->records
+        , memory_order_relaxed);
+    do
+    {
+        record->next = head;
+    }
+    while (!atomic_compare_exchange_weak_explicit(&domain->records, &head
+        , record, memory_order_release, memory_order_relaxed));
+    return record;
+}
+
+struct epoch_record* epoch_register(epoch_t* domain)
+{
+    struct epoch_record* record = tss_get(domain->key);
+    if (record)
+        return record;
+    record = acquire_record(domain);
+    if (record == NULL)
+        return NULL;
+    if (tss_set(domain->key, record) != thrd_success)
+    {
+        release_record(record);
+        return NULL;
+    }
+    return record;
+}
+
+void epoch_unregister(struct epoch_record* record)
+{
+    tss_set(record->domain->key, NULL);
+    release_record(record);
+}
+
+/*
+ *  The fence pairs with the one in epoch_enter: either the scan
+ *  sees a thread's state, or that thread sees the epoch (and
+ *  everything unlinked before it was advanced).
+ */
+
+static void try_advance(epoch_t* domain, unsigned int epoch)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    struct epoch_record* record = atomic_load_explicit(&domain->records
+        , memory_order_acquire);
+    for (; record; record = record->next)
+    {
+        unsigned int state = atomic_load_explicit(&record->state
+            , memory_order_relaxed);
+        if ((state & 1) && (state & ~1u) != epoch)
+            return;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    atomic_compare_exchange_strong_explicit(&domain->epoch, &epoch
+        , epoch + 2, memory_order_release, memory_order_relaxed);
+}
+
+void epoch_retire(struct epoch_record* record, struct epoch_node* node
+    , epoch_free_t fn)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    unsigned int epoch = atomic_load_explicit(&record->domain->epoch
+        , memory_order_relaxed);
+
+    /*
+     *  Tags are distinct and at most one is epoch - 2, so unless
+     *  a list for this epoch exists, one of them is empty or has
+     *  expired and can be reused.
+     */
+
+    struct epoch_limbo* limbo = NULL;
+    for (int i = 0; i < 3 && !limbo; ++i)
+    {
+        if (record->limbo[i].epoch == epoch)
+            limbo = &record->limbo[i];
+    }
+    for (int i = 0; i < 3 && !limbo; ++i)
+    {
+        if (record->limbo[i].head == NULL
+            || expired(epoch, record->limbo[i].epoch))
+        {
+            limbo = &record->limbo[i];
+            record->pending -= free_nodes(limbo->head);
+            limbo->head = NULL;
+            limbo->epoch = epoch;
+        }
+    }
+    node->free = fn;
+    node->next = limbo->head;
+    limbo->head = node;
+    if (++record->pending >= EPOCH_BATCH)
+        epoch_poll(record);
+}
+
+size_t epoch_poll(struct epoch_record* record)
+{
+    epoch_t* domain = record->domain;
+    try_advance(domain, atomic_load_explicit(&domain->epoch
+        , memory_order_relaxed));
+    unsigned int epoch = atomic_load_explicit(&domain->epoch
+        , memory_order_acquire);
+    size_t count = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        struct epoch_limbo* limbo = &record->limbo[i];
+        if (limbo->head && expired(epoch, limbo->epoch))
+        {
+            count += free_nodes(limbo->head);
+            limbo->head = NULL;
+        }
+    }
+    record->pending -= count;
+    return count;
+}
+
+void epoch_barrier(struct epoch_record* record)
+{
+    while (record->pending)
+    {
+        if (epoch_poll(record) == 0)
+            thrd_yield();
+    }
+}
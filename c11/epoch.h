@@ -0,0 +1,134 @@
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <c11/_cdefs.h>
+#include <stddef.h>
+#include <c11/stdatomic.h>
+#include <c11/threads.h>
+
+/*
+ *  Epoch-based memory reclamation (non-standard)
+ *
+ *  Threads register with a domain and read shared nodes between
+ *  epoch_enter and epoch_exit. Unlinked nodes are retired into
+ *  per-thread lists tagged with the global epoch, which only
+ *  advances once every thread inside a critical section has
+ *  seen the current one. Nodes retired two advances ago can no
+ *  longer be referenced and are freed in batches.
+ */
+
+#if !defined(CACHELINE_SIZE)
+#   define CACHELINE_SIZE 64
+#endif /* !defined(CACHELINE_SIZE) */
+
+/*
+ *  Number of retired nodes after which epoch_retire tries to
+ *  advance the epoch and free what it can
+ */
+
+#if !defined(EPOCH_BATCH)
+#   define EPOCH_BATCH 64
+#endif /* !defined(EPOCH_BATCH) */
+
+struct epoch_node;
+
+typedef void (*epoch_free_t)(struct epoch_node* node);
+
+/*
+ *  Embedded in the retired items, so retiring never allocates
+ */
+
+struct epoch_node
+{
+    struct epoch_node* next;
+    epoch_free_t free;
+};
+
+struct epoch_record;
+
+typedef struct
+{
+    _Alignas(CACHELINE_SIZE) atomic_uint epoch;
+    _Alignas(CACHELINE_SIZE) _Atomic(struct epoch_record*) records;
+    tss_t key;
+} epoch_t;
+
+/*
+ *  Per-thread participant. The low bit of state marks it as
+ *  inside a critical section, the rest is the epoch it entered
+ *  in (that's why the global epoch advances in steps of 2).
+ *  Records are never freed before the domain; when a thread
+ *  exits its record (including the nodes still waiting to be
+ *  freed) is handed to the next thread that registers.
+ */
+
+struct epoch_limbo
+{
+    struct epoch_node* head;
+    unsigned int epoch;
+};
+
+struct epoch_record
+{
+    _Alignas(CACHELINE_SIZE) atomic_uint state;
+    unsigned int nesting;
+    atomic_uint in_use;
+    struct epoch_record* next;
+    epoch_t* domain;
+    size_t pending;
+    struct epoch_limbo limbo[3];
+};
+
+/*
+ *  epoch_destroy frees all nodes that are still retired, no
+ *  thread may use the domain any more. epoch_register returns
+ *  the record of the calling thread (NULL if out of memory),
+ *  calling it again is cheap. Critical sections can be nested.
+ *
+ *  epoch_poll tries to advance the epoch and frees the nodes of
+ *  the record that have become safe, it returns their number.
+ *  epoch_barrier keeps polling until all of them are freed and
+ *  must not be called inside a critical section.
+ */
+
+void epoch_destroy(epoch_t* domain);
+
+int epoch_init(epoch_t* domain);
+
+struct epoch_record* epoch_register(epoch_t* domain);
+
+void epoch_unregister(struct epoch_record* record);
+
+static inline void epoch_enter(struct epoch_record* record)
+{
+    if (record->nesting++ == 0)
+    {
+        unsigned int epoch = atomic_load_explicit(&record->domain->epoch
+            , memory_order_relaxed);
+        atomic_store_explicit(&record->state, epoch | 1
+            , memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+}
+
+static inline void epoch_exit(struct epoch_record* record)
+{
+    if (--record->nesting == 0)
+        atomic_store_explicit(&record->state, 0, memory_order_release);
+}
+
+void epoch_retire(struct epoch_record* record, struct epoch_node* node
+    , epoch_free_t fn);
+
+size_t epoch_poll(struct epoch_record* record);
+
+void epoch_barrier(struct epoch_record* record);
+
+#endif /* __EPOCH_H__ */
@@ -0,0 +1,285 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include <c11/queue.h>
+
+#include <c11/aligned_alloc.h>
+
+/*
+ *  Multi-producer/multi-consumer queue
+ */
+
+void mpmc_destroy(mpmc_t* queue)
+{
+    aligned_free(queue->cells);
+}
+
+int mpmc_init(mpmc_t* queue, size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+    struct mpmc_cell* cells = aligned_alloc(CACHELINE_SIZE
+        , size * sizeof(struct mpmc_cell));
+    if (cells == NULL)
+        return thrd_nomem;
+    for (size_t i = 0; i < size; i++)
+    {
+        atomic_init(&cells[i].seq, i);
+        cells[i].item = NULL;
+    }
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->cells = cells;
+    queue->mask = size - 1;
+    return thrd_success;
+}
+
+/*
+ *  The bulk variants count the run of ready cells starting at
+ *  pos, then claim all of them with a single CAS. Cells become
+ *  ready out of order, so each one of them has to be checked.
+ */
+
+size_t mpmc_push_n(mpmc_t* queue, void* const* items, size_t count)
+{
+    size_t pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    for (;;)
+    {
+        size_t ready = 0;
+        while (ready < count && ready <= queue->mask)
+        {
+            struct mpmc_cell* cell = &queue->cells[(pos + ready)
+                & queue->mask];
+            if (atomic_load_explicit(&cell->seq
+                , memory_order_acquire) != pos + ready)
+                break;
+            ready++;
+        }
+        if (ready == 0)
+        {
+            size_t seq = atomic_load_explicit(&queue->cells[pos
+                & queue->mask].seq, memory_order_relaxed);
+            if ((intptr_t)seq - (intptr_t)pos < 0)
+                return 0;
+            pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&queue->head, &pos
+            , pos + ready, memory_order_relaxed, memory_order_relaxed))
+        {
+            for (size_t i = 0; i < ready; i++)
+            {
+                struct mpmc_cell* cell = &queue->cells[(pos + i)
+                    & queue->mask];
+                cell->item = items[i];
+                atomic_store_explicit(&cell->seq, pos + i + 1
+                    , memory_order_release);
+            }
+            return ready;
+        }
+    }
+}
+
+size_t mpmc_pop_n(mpmc_t* queue, void** items, size_t count)
+{
+    size_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    for (;;)
+    {
+        size_t ready = 0;
+        while (ready < count && ready <= queue->mask)
+        {
+            struct mpmc_cell* cell = &queue->cells[(pos + ready)
+                & queue->mask];
+            if (atomic_load_explicit(&cell->seq
+                , memory_order_acquire) != pos + ready + 1)
+                break;
+            ready++;
+        }
+        if (ready == 0)
+        {
+            size_t seq = atomic_load_explicit(&queue->cells[pos
+                & queue->mask].seq, memory_order_relaxed);
+            if ((intptr_t)seq - (intptr_t)(pos + 1) < 0)
+                return 0;
+            pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&queue->tail, &pos
+            , pos + ready, memory_order_relaxed, memory_order_relaxed))
+        {
+            for (size_t i = 0; i < ready; i++)
+            {
+                struct mpmc_cell* cell = &queue->cells[(pos + i)
+                    & queue->mask];
+                items[i] = cell->item;
+                atomic_store_explicit(&cell->seq, pos + i + queue->mask + 1
+                    , memory_order_release);
+            }
+            return ready;
+        }
+    }
+}
+
+/*
+ *  Single-producer/single-consumer ring
+ */
+
+void spsc_destroy(spsc_t* ring)
+{
+    aligned_free(ring->buffer);
+}
+
+int spsc_init(spsc_t* ring, size_t capacity, size_t size)
+{
+    size_t count = 1;
+    while (count < capacity)
+        count <<= 1;
+    size_t nbtotal = (count * size + CACHELINE_SIZE - 1)
+        / CACHELINE_SIZE * CACHELINE_SIZE;
+    unsigned char* buffer = aligned_alloc(CACHELINE_SIZE, nbtotal);
+    if (buffer == NULL)
+        return thrd_nomem;
+    atomic_init(&ring->head, 0);
+    ring->tail_cache = 0;
+    atomic_init(&ring->tail, 0);
+    ring->head_cache = 0;
+    ring->buffer = buffer;
+    ring->mask = count - 1;
+    ring->size = size;
+    return thrd_success;
+}
+
+/*
+ *  Intrusive multi-producer/single-consumer queue
+ */
+
+void mpsc_destroy(mpsc_t* queue)
+{
+    cnd_destroy(&queue->cond);
+    mtx_destroy(&queue->lock);
+}
+
+int mpsc_init(mpsc_t* queue)
+{
+    int res = mtx_init(&queue->lock, mtx_plain);
+    if (res != thrd_success)
+        return res;
+    res = cnd_init(&queue->cond);
+    if (res != thrd_success)
+    {
+        mtx_destroy(&queue->lock);
+        return res;
+    }
+    atomic_init(&queue->stub.next, NULL);
+    atomic_init(&queue->head, &queue->stub);
+    queue->tail = &queue->stub;
+    atomic_init(&queue->sleeping, 0);
+    return thrd_success;
+}
+
+void mpsc_wake(mpsc_t* queue)
+{
+    mtx_lock(&queue->lock);
+    cnd_signal(&queue->cond);
+    mtx_unlock(&queue->lock);
+}
+
+static void push_stub(mpsc_t* queue)
+{
+    struct mpsc_node* stub = &queue->stub;
+    atomic_store_explicit(&stub->next, NULL, memory_order_relaxed);
+    struct mpsc_node* prev = atomic_exchange_explicit(&queue->head, stub
+        , memory_order_seq_cst);
+    atomic_store_explicit(&prev->next, stub, memory_order_release);
+}
+
+int mpsc_trypop(mpsc_t* queue, struct mpsc_node** node)
+{
+    struct mpsc_node* tail = queue->tail;
+    struct mpsc_node* next = atomic_load_explicit(&tail->next
+        , memory_order_acquire);
+    if (tail == &queue->stub)
+    {
+        if (next == NULL)
+            return thrd_busy;
+        queue->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+    if (next == NULL)
+    {
+        /*
+         *  tail is the last linked node. Unless a producer is
+         *  between its exchange and the link, re-insert the stub
+         *  behind it so that tail can be handed out.
+         */
+        if (tail != atomic_load_explicit(&queue->head, memory_order_acquire))
+            return thrd_busy;
+        push_stub(queue);
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+        if (next == NULL)
+            return thrd_busy;
+    }
+    queue->tail = next;
+    *node = tail;
+    return thrd_success;
+}
+
+/*
+ *  The queue is empty when both ends are at the stub. Parking
+ *  sets sleeping before checking that (and producers check it
+ *  after their exchange), all seq_cst, so either the consumer
+ *  sees the node or the producer sees the flag and signals under
+ *  the lock.
+ */
+
+static int is_empty(mpsc_t* queue)
+{
+    return queue->tail == &queue->stub
+        && atomic_load_explicit(&queue->head, memory_order_seq_cst)
+            == &queue->stub;
+}
+
+int mpsc_pop(mpsc_t* queue, struct mpsc_node** node)
+{
+    return mpsc_timedpop(queue, node, NULL);
+}
+
+int mpsc_timedpop(mpsc_t* queue, struct mpsc_node** node
+    , const struct timespec* ts)
+{
+    for (;;)
+    {
+        if (mpsc_trypop(queue, node) == thrd_success)
+            return thrd_success;
+        if (!is_empty(queue))
+        {
+            thrd_yield();
+            continue;
+        }
+        int res = thrd_success;
+        mtx_lock(&queue->lock);
+        atomic_store_explicit(&queue->sleeping, 1, memory_order_seq_cst);
+        if (is_empty(queue))
+        {
+            res = ts ? cnd_timedwait(&queue->cond, &queue->lock, ts)
+                : cnd_wait(&queue->cond, &queue->lock);
+        }
+        atomic_store_explicit(&queue->sleeping, 0, memory_order_relaxed);
+        mtx_unlock(&queue->lock);
+        if (res == thrd_timedout)
+            return (mpsc_trypop(queue, node) == thrd_success)
+                ? thrd_success : thrd_timedout;
+        if (res != thrd_success)
+            return res;
+    }
+}
@@ -0,0 +1,284 @@
+#ifndef __QUEUE_H__
+#define __QUEUE_H__
+
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <c11/_cdefs.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <c11/stdatomic.h>
+#include <c11/threads.h>
+
+/*
+ *  Lock-free queues (non-standard)
+ */
+
+#if !defined(CACHELINE_SIZE)
+#   define CACHELINE_SIZE 64
+#endif /* !defined(CACHELINE_SIZE) */
+
+/*
+ *  Bounded multi-producer/multi-consumer queue (Dmitry Vyukov).
+ *  Every cell carries a sequence number: pos when it is free for
+ *  the producer at pos, pos + 1 when it holds the item for the
+ *  consumer at pos. head (producers), tail (consumers) and the
+ *  cells sit on separate cache lines.
+ */
+
+struct mpmc_cell
+{
+    atomic_size_t seq;
+    void* item;
+};
+
+typedef struct
+{
+    _Alignas(CACHELINE_SIZE) atomic_size_t head;
+    _Alignas(CACHELINE_SIZE) atomic_size_t tail;
+    _Alignas(CACHELINE_SIZE) struct mpmc_cell* cells;
+    size_t mask;
+} mpmc_t;
+
+/*
+ *  mpmc_init rounds the capacity up to a power of two. Push and
+ *  pop never block, they return thrd_busy if the queue is full
+ *  or empty respectively. The bulk variants move as many items
+ *  as possible (up to count) and return their number.
+ */
+
+void mpmc_destroy(mpmc_t* queue);
+
+int mpmc_init(mpmc_t* queue, size_t capacity);
+
+static inline int mpmc_push(mpmc_t* queue, void* item)
+{
+    size_t pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    for (;;)
+    {
+        struct mpmc_cell* cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &pos
+                , pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                cell->item = item;
+                atomic_store_explicit(&cell->seq, pos + 1
+                    , memory_order_release);
+                return thrd_success;
+            }
+        }
+        else if (diff < 0)
+        {
+            return thrd_busy;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+}
+
+static inline int mpmc_pop(mpmc_t* queue, void** item)
+{
+    size_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    for (;;)
+    {
+        struct mpmc_cell* cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &pos
+                , pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                *item = cell->item;
+                atomic_store_explicit(&cell->seq, pos + queue->mask + 1
+                    , memory_order_release);
+                return thrd_success;
+            }
+        }
+        else if (diff < 0)
+        {
+            return thrd_busy;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+}
+
+size_t mpmc_push_n(mpmc_t* queue, void* const* items, size_t count);
+
+size_t mpmc_pop_n(mpmc_t* queue, void** items, size_t count);
+
+/*
+ *  Single-producer/single-consumer ring of fixed-size elements.
+ *  Each side keeps a private copy of the index of the other side
+ *  on its own cache line and only reloads it when the copy says
+ *  the ring is full (or empty), so the fast path doesn't touch
+ *  any line written by the other side.
+ */
+
+typedef struct
+{
+    _Alignas(CACHELINE_SIZE) atomic_size_t head;
+    size_t tail_cache;
+    _Alignas(CACHELINE_SIZE) atomic_size_t tail;
+    size_t head_cache;
+    _Alignas(CACHELINE_SIZE) unsigned char* buffer;
+    size_t mask;
+    size_t size;
+} spsc_t;
+
+/*
+ *  spsc_init rounds the capacity (in elements of size bytes) up
+ *  to a power of two.
+ *
+ *  spsc_reserve returns a contiguous span of up to *count free
+ *  elements for the producer to write in place and stores its
+ *  length in *count (it can be shorter where the ring wraps, and
+ *  zero if the ring is full). spsc_commit publishes the first
+ *  count elements of the span. spsc_peek and spsc_release are
+ *  the consumer side counterparts. spsc_push and spsc_pop copy
+ *  single elements and return thrd_busy if the ring is full or
+ *  empty respectively.
+ */
+
+void spsc_destroy(spsc_t* ring);
+
+int spsc_init(spsc_t* ring, size_t capacity, size_t size);
+
+static inline void* spsc_reserve(spsc_t* ring, size_t* count)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t capacity = ring->mask + 1;
+    size_t avail = capacity - (head - ring->tail_cache);
+    if (avail < *count)
+    {
+        ring->tail_cache = atomic_load_explicit(&ring->tail
+            , memory_order_acquire);
+        avail = capacity - (head - ring->tail_cache);
+    }
+    size_t offset = head & ring->mask;
+    size_t span = capacity - offset;
+    avail = (avail < span) ? avail : span;
+    *count = (*count < avail) ? *count : avail;
+    return ring->buffer + offset * ring->size;
+}
+
+static inline void spsc_commit(spsc_t* ring, size_t count)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + count, memory_order_release);
+}
+
+static inline void* spsc_peek(spsc_t* ring, size_t* count)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t avail = ring->head_cache - tail;
+    if (avail < *count)
+    {
+        ring->head_cache = atomic_load_explicit(&ring->head
+            , memory_order_acquire);
+        avail = ring->head_cache - tail;
+    }
+    size_t offset = tail & ring->mask;
+    size_t span = ring->mask + 1 - offset;
+    avail = (avail < span) ? avail : span;
+    *count = (*count < avail) ? *count : avail;
+    return ring->buffer + offset * ring->size;
+}
+
+static inline void spsc_release(spsc_t* ring, size_t count)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+}
+
+static inline int spsc_push(spsc_t* ring, const void* item)
+{
+    size_t count = 1;
+    void* slot = spsc_reserve(ring, &count);
+    if (count == 0)
+        return thrd_busy;
+    memcpy(slot, item, ring->size);
+    spsc_commit(ring, 1);
+    return thrd_success;
+}
+
+static inline int spsc_pop(spsc_t* ring, void* item)
+{
+    size_t count = 1;
+    void* slot = spsc_peek(ring, &count);
+    if (count == 0)
+        return thrd_busy;
+    memcpy(item, slot, ring->size);
+    spsc_release(ring, 1);
+    return thrd_success;
+}
+
+/*
+ *  Intrusive multi-producer/single-consumer queue (Dmitry Vyukov).
+ *  Nodes are embedded in the items, so the queue never allocates.
+ *  A push is one exchange on head followed by a store linking the
+ *  previous node, the consumer walks the links from tail without
+ *  any locking. An embedded stub node keeps the list non-empty,
+ *  which means the queue must not be moved after mpsc_init.
+ */
+
+struct mpsc_node
+{
+    _Atomic(struct mpsc_node*) next;
+};
+
+typedef struct
+{
+    _Alignas(CACHELINE_SIZE) _Atomic(struct mpsc_node*) head;
+    _Alignas(CACHELINE_SIZE) struct mpsc_node* tail;
+    struct mpsc_node stub;
+    _Alignas(CACHELINE_SIZE) atomic_uint sleeping;
+    mtx_t lock;
+    cnd_t cond;
+} mpsc_t;
+
+/*
+ *  mpsc_trypop returns thrd_busy if the queue is empty or if the
+ *  next node has been pushed but not linked yet. mpsc_pop parks
+ *  the consumer on the condition variable while the queue is
+ *  empty, producers only touch the lock if it is parked.
+ *  mpsc_timedpop gives up at the absolute (TIME_UTC) time ts.
+ */
+
+void mpsc_destroy(mpsc_t* queue);
+
+int mpsc_init(mpsc_t* queue);
+
+void mpsc_wake(mpsc_t* queue);
+
+static inline void mpsc_push(mpsc_t* queue, struct mpsc_node* node)
+{
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    struct mpsc_node* prev = atomic_exchange_explicit(&queue->head, node
+        , memory_order_seq_cst);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+    if (atomic_load_explicit(&queue->sleeping, memory_order_seq_cst))
+        mpsc_wake(queue);
+}
+
+int mpsc_trypop(mpsc_t* queue, struct mpsc_node** node);
+
+int mpsc_pop(mpsc_t* queue, struct mpsc_node** node);
+
+int mpsc_timedpop(mpsc_t* queue, struct mpsc_node** node
+    , const struct timespec* ts);
+
+#endif /* __QUEUE_H__ */
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include <c11/stdatomic.h>
+#include <c11/threads.h>
+
+static uint64_t load_value(const volatile void* obj, size_t size
+    , memory_order order)
+{
+    switch (size)
+    {
+    case 1:
+        return (uint8_t)atomic_load_explicit(
+            (atomic_uint_least8_t*)obj, order);
+    case 2:
+        return (uint16_t)atomic_load_explicit(
+            (atomic_uint_least16_t*)obj, order);
+    case 4:
+        return (uint32_t)atomic_load_explicit(
+            (atomic_uint_least32_t*)obj, order);
+    default:
+        return (uint64_t)atomic_load_explicit(
+            (atomic_uint_least64_t*)obj, order);
+    }
+}
+
+/*
+ *  32-bit objects are waited on directly (thrd_wait_address).
+ *  Everything else waits on a sequence word hashed by address,
+ *  which notifiers bump after the value has changed: a waiter
+ *  that still sees the old value read the sequence before the
+ *  bump, so it either doesn't block or gets woken. Sequence words
+ *  are shared, hence a notify has to wake all of their waiters.
+ */
+
+#define WAIT_SEQUENCE_BITS 6
+
+static atomic_uint g_wait_sequences[1 << WAIT_SEQUENCE_BITS];
+
+static atomic_uint* wait_sequence(const volatile void* obj)
+{
+    uint32_t hash = (uint32_t)((uintptr_t)obj >> 2) * 2654435769U;
+    return &g_wait_sequences[hash >> (32 - WAIT_SEQUENCE_BITS)];
+}
+
+void atomic_wait_address(const volatile void* obj, size_t size
+    , uint64_t old, memory_order order)
+{
+    if (size < sizeof(uint64_t))
+        old &= ((uint64_t)1 << (size * 8)) - 1;
+    if (size == sizeof(unsigned int))
+    {
+        while (load_value(obj, size, order) == old)
+            thrd_wait_address((atomic_uint*)obj, (unsigned int)old);
+        return;
+    }
+    atomic_uint* sequence = wait_sequence(obj);
+    for (;;)
+    {
+        unsigned int seen = atomic_load_explicit(sequence
+            , memory_order_acquire);
+        if (load_value(obj, size, order) != old)
+            return;
+        thrd_wait_address(sequence, seen);
+    }
+}
+
+void atomic_notify_address(const volatile void* obj, size_t size, int all)
+{
+    if (size == sizeof(unsigned int))
+    {
+        thrd_wake_address((atomic_uint*)obj, all);
+        return;
+    }
+    atomic_uint* sequence = wait_sequence(obj);
+    atomic_fetch_add_explicit(sequence, 1, memory_order_release);
+    thrd_wake_address(sequence, 1);
+}
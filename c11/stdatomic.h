@@ -950,6 +950,36 @@ atomic_fetch_and_8(volatile atomic_llong* obj, __int64 op
 
 #endif /* defined(HAVE_STDATOMIC_H_WORKAROUND) */
 
+/*
+ *  Waiting and notifying (non-standard, like C++20)
+ *
+ *  atomic_wait_explicit blocks until the value of obj (loaded
+ *  with order) differs from old, atomic_notify_one and _all
+ *  wake threads waiting on obj. Spurious wakeups are taken care
+ *  of, but like with a futex the value has to change before
+ *  notifying. Only integer types of 1, 2, 4 or 8 bytes qualify.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+void atomic_wait_address(const volatile void* obj, size_t size
+    , uint64_t old, memory_order order);
+
+void atomic_notify_address(const volatile void* obj, size_t size, int all);
+
+#define atomic_wait_explicit(obj, old, order) \
+    atomic_wait_address((obj), sizeof(*(obj)), (uint64_t)(old), (order))
+
+#define atomic_wait(obj, old) \
+    atomic_wait_explicit((obj), (old), memory_order_seq_cst)
+
+#define atomic_notify_one(obj) \
+    atomic_notify_address((obj), sizeof(*(obj)), 0)
+
+#define atomic_notify_all(obj) \
+    atomic_notify_address((obj), sizeof(*(obj)), 1)
+
 #undef HAVE_STDATOMIC_H_WORKAROUND
 
 #endif /* __STDATOMIC_H__ */
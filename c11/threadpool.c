@@ -0,0 +1,734 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <c11/threadpool.h>
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <c11/aligned_alloc.h>
+
+/*
+ *  Number of jobs a worker moves from an inbox to its deque
+ *  at once, and of stealing rounds before it parks.
+ */
+
+#define TPOOL_BATCH 16
+#define TPOOL_ROUNDS 4
+
+struct tpool_job
+{
+    thrd_start_t func;
+    void* arg;
+};
+
+/*
+ *  Slots are read by thieves while the owner may overwrite
+ *  them (a thief that loses the race on top discards what it
+ *  has read), so they are accessed with relaxed atomics.
+ */
+
+struct tpool_slot
+{
+    _Atomic(thrd_start_t) func;
+    _Atomic(void*) arg;
+};
+
+struct tpool_buffer
+{
+    struct tpool_buffer* next;
+    ptrdiff_t mask;
+    struct tpool_slot slots[];
+};
+
+/*
+ *  top is written by thieves, bottom only by the owner, so
+ *  they live on separate cache lines. Buffers replaced by a
+ *  larger one may still be read by thieves and are only freed
+ *  by tpool_destroy.
+ */
+
+struct tpool_worker
+{
+    _Alignas(CACHELINE_SIZE) atomic_ptrdiff_t top;
+    _Alignas(CACHELINE_SIZE) atomic_ptrdiff_t bottom;
+    _Atomic(struct tpool_buffer*) buffer;
+    struct tpool_buffer* retired;
+    tpool_t* pool;
+    thrd_t thrd;
+    unsigned int seed;
+    _Alignas(CACHELINE_SIZE) mtx_t inbox_lock;
+    atomic_size_t inbox_count;
+    size_t inbox_head;
+    size_t inbox_capacity;
+    struct tpool_job* inbox;
+};
+
+static _Thread_local struct tpool_worker* t_worker;
+
+/*
+ *  Chase-Lev deque, with the C11 memory orders of Le et al.,
+ *  "Correct and Efficient Work-Stealing for Weak Memory Models"
+ */
+
+static struct tpool_buffer* alloc_buffer(ptrdiff_t size)
+{
+    struct tpool_buffer* buffer = malloc(offsetof(struct tpool_buffer
+        , slots) + size * sizeof(struct tpool_slot));
+    if (buffer)
+    {
+        buffer->next = NULL;
+        buffer->mask = size - 1;
+    }
+    return buffer;
+}
+
+static inline void store_job(struct tpool_buffer* buffer, ptrdiff_t index
+    , thrd_start_t func, void* arg)
+{
+    struct tpool_slot* slot = &buffer->slots[index & buffer->mask];
+    atomic_store_explicit(&slot->func, func, memory_order_relaxed);
+    atomic_store_explicit(&slot->arg, arg, memory_order_relaxed);
+}
+
+static inline void load_job(struct tpool_buffer* buffer, ptrdiff_t index
+    , struct tpool_job* job)
+{
+    struct tpool_slot* slot = &buffer->slots[index & buffer->mask];
+    job->func = atomic_load_explicit(&slot->func, memory_order_relaxed);
+    job->arg = atomic_load_explicit(&slot->arg, memory_order_relaxed);
+}
+
+static struct tpool_buffer* grow(struct tpool_worker* worker
+    , struct tpool_buffer* buffer, ptrdiff_t top, ptrdiff_t bottom)
+{
+    struct tpool_buffer* larger = alloc_buffer((buffer->mask + 1) * 2);
+    if (larger == NULL)
+        return NULL;
+    for (ptrdiff_t i = top; i < bottom; i++)
+    {
+        struct tpool_job job;
+        load_job(buffer, i, &job);
+        store_job(larger, i, job.func, job.arg);
+    }
+    atomic_store_explicit(&worker->buffer, larger, memory_order_release);
+    buffer->next = worker->retired;
+    worker->retired = buffer;
+    return larger;
+}
+
+static int push(struct tpool_worker* worker, thrd_start_t func, void* arg)
+{
+    ptrdiff_t bottom = atomic_load_explicit(&worker->bottom
+        , memory_order_relaxed);
+    ptrdiff_t top = atomic_load_explicit(&worker->top
+        , memory_order_acquire);
+    struct tpool_buffer* buffer = atomic_load_explicit(&worker->buffer
+        , memory_order_relaxed);
+    if (bottom - top > buffer->mask)
+    {
+        buffer = grow(worker, buffer, top, bottom);
+        if (buffer == NULL)
+            return thrd_nomem;
+    }
+    store_job(buffer, bottom, func, arg);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+    return thrd_success;
+}
+
+static int take(struct tpool_worker* worker, struct tpool_job* job)
+{
+    ptrdiff_t bottom = atomic_load_explicit(&worker->bottom
+        , memory_order_relaxed) - 1;
+    struct tpool_buffer* buffer = atomic_load_explicit(&worker->buffer
+        , memory_order_relaxed);
+    atomic_store_explicit(&worker->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    ptrdiff_t top = atomic_load_explicit(&worker->top
+        , memory_order_relaxed);
+    if (top > bottom)
+    {
+        atomic_store_explicit(&worker->bottom, bottom + 1
+            , memory_order_relaxed);
+        return 0;
+    }
+    load_job(buffer, bottom, job);
+    if (top < bottom)
+        return 1;
+    int taken = atomic_compare_exchange_strong_explicit(&worker->top
+        , &top, top + 1, memory_order_seq_cst, memory_order_relaxed);
+    atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+    return taken;
+}
+
+/*
+ *  Returns 1 on success, 0 if the deque is empty and -1 if
+ *  another thread won the race for the top job.
+ */
+
+static int steal(struct tpool_worker* worker, struct tpool_job* job)
+{
+    ptrdiff_t top = atomic_load_explicit(&worker->top
+        , memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    ptrdiff_t bottom = atomic_load_explicit(&worker->bottom
+        , memory_order_acquire);
+    if (top >= bottom)
+        return 0;
+    struct tpool_buffer* buffer = atomic_load_explicit(&worker->buffer
+        , memory_order_acquire);
+    load_job(buffer, top, job);
+    if (!atomic_compare_exchange_strong_explicit(&worker->top, &top
+        , top + 1, memory_order_seq_cst, memory_order_relaxed))
+        return -1;
+    return 1;
+}
+
+/*
+ *  Inboxes are ring buffers protected by inbox_lock, the count
+ *  can be peeked at without taking the lock.
+ */
+
+static int post(struct tpool_worker* worker, thrd_start_t func, void* arg)
+{
+    mtx_lock(&worker->inbox_lock);
+    size_t count = atomic_load_explicit(&worker->inbox_count
+        , memory_order_relaxed);
+    if (count == worker->inbox_capacity)
+    {
+        size_t capacity = count ? count * 2 : TPOOL_BATCH;
+        struct tpool_job* inbox = malloc(capacity * sizeof(*inbox));
+        if (inbox == NULL)
+        {
+            mtx_unlock(&worker->inbox_lock);
+            return thrd_nomem;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            inbox[i] = worker->inbox[(worker->inbox_head + i)
+                % worker->inbox_capacity];
+        }
+        free(worker->inbox);
+        worker->inbox = inbox;
+        worker->inbox_head = 0;
+        worker->inbox_capacity = capacity;
+    }
+    struct tpool_job* job = &worker->inbox[(worker->inbox_head + count)
+        % worker->inbox_capacity];
+    job->func = func;
+    job->arg = arg;
+    atomic_store_explicit(&worker->inbox_count, count + 1
+        , memory_order_relaxed);
+    mtx_unlock(&worker->inbox_lock);
+    return thrd_success;
+}
+
+static size_t receive(struct tpool_worker* worker, struct tpool_job* jobs
+    , size_t max)
+{
+    if (atomic_load_explicit(&worker->inbox_count
+        , memory_order_relaxed) == 0)
+        return 0;
+    mtx_lock(&worker->inbox_lock);
+    size_t count = atomic_load_explicit(&worker->inbox_count
+        , memory_order_relaxed);
+    count = (count < max) ? count : max;
+    for (size_t i = 0; i < count; i++)
+    {
+        jobs[i] = worker->inbox[worker->inbox_head];
+        worker->inbox_head = (worker->inbox_head + 1)
+            % worker->inbox_capacity;
+    }
+    atomic_fetch_sub_explicit(&worker->inbox_count, count
+        , memory_order_relaxed);
+    mtx_unlock(&worker->inbox_lock);
+    return count;
+}
+
+/*
+ *  Moves a batch of jobs from the inbox of victim to the deque
+ *  of self (where others can steal them) and returns the first.
+ *  If the deque can't grow, the jobs are run right away.
+ */
+
+static int drain(struct tpool_worker* self, struct tpool_worker* victim
+    , struct tpool_job* job)
+{
+    struct tpool_job jobs[TPOOL_BATCH];
+    size_t count = receive(victim, jobs, TPOOL_BATCH);
+    if (count == 0)
+        return 0;
+    for (size_t i = count - 1; i > 0; i--)
+    {
+        if (push(self, jobs[i].func, jobs[i].arg) != thrd_success)
+            jobs[i].func(jobs[i].arg);
+    }
+    *job = jobs[0];
+    return 1;
+}
+
+static unsigned int next_random(struct tpool_worker* worker)
+{
+    unsigned int x = worker->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    worker->seed = x;
+    return x;
+}
+
+static int find_job(struct tpool_worker* self, struct tpool_job* job)
+{
+    if (take(self, job) || drain(self, self, job))
+        return 1;
+    tpool_t* pool = self->pool;
+    unsigned int start = next_random(self) % pool->count;
+    for (unsigned int i = 0; i < pool->count; i++)
+    {
+        struct tpool_worker* victim = &pool->workers[(start + i)
+            % pool->count];
+        if (victim == self)
+            continue;
+        int res = 0;
+        do
+        {
+            res = steal(victim, job);
+        }
+        while (res < 0);
+        if (res || drain(self, victim, job))
+            return 1;
+    }
+    return 0;
+}
+
+static int has_work(tpool_t* pool)
+{
+    for (unsigned int i = 0; i < pool->count; i++)
+    {
+        struct tpool_worker* worker = &pool->workers[i];
+        if (atomic_load_explicit(&worker->top, memory_order_relaxed)
+            < atomic_load_explicit(&worker->bottom, memory_order_relaxed)
+            || atomic_load_explicit(&worker->inbox_count
+                , memory_order_relaxed))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ *  Sleepers announce themselves before they look for work a
+ *  last time, producers publish their job before they look
+ *  for sleepers: with the fences in between, either the job
+ *  is seen or the sleeper gets signaled (under the lock, so
+ *  the signal can't get lost).
+ */
+
+static void wake_one(tpool_t* pool)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&pool->sleepers, memory_order_relaxed) == 0)
+        return;
+    mtx_lock(&pool->lock);
+    cnd_signal(&pool->cond);
+    mtx_unlock(&pool->lock);
+}
+
+static int park(tpool_t* pool)
+{
+    int done = 0;
+    mtx_lock(&pool->lock);
+    atomic_fetch_add_explicit(&pool->sleepers, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!has_work(pool))
+    {
+        if (atomic_load_explicit(&pool->stopping, memory_order_relaxed))
+            done = 1;
+        else
+            cnd_wait(&pool->cond, &pool->lock);
+    }
+    atomic_fetch_sub_explicit(&pool->sleepers, 1, memory_order_relaxed);
+    mtx_unlock(&pool->lock);
+    return done;
+}
+
+static int worker_main(void* arg)
+{
+    struct tpool_worker* self = arg;
+    t_worker = self;
+    for (;;)
+    {
+        struct tpool_job job;
+        int found = 0;
+        for (int i = 0; i < TPOOL_ROUNDS && !found; i++)
+        {
+            found = find_job(self, &job);
+            if (!found)
+                thrd_yield();
+        }
+        if (found)
+            job.func(job.arg);
+        else if (park(self->pool))
+            break;
+    }
+    t_worker = NULL;
+    return 0;
+}
+
+static int init_worker(tpool_t* pool, struct tpool_worker* worker
+    , unsigned int index)
+{
+    worker->pool = pool;
+    worker->seed = 2654435769U * (index + 1);
+    struct tpool_buffer* buffer = alloc_buffer(TPOOL_BATCH * 4);
+    if (buffer == NULL)
+        return thrd_nomem;
+    atomic_init(&worker->buffer, buffer);
+    if (mtx_init(&worker->inbox_lock, mtx_plain) != thrd_success)
+    {
+        free(buffer);
+        return thrd_error;
+    }
+    return thrd_success;
+}
+
+static void free_worker(struct tpool_worker* worker)
+{
+    free(atomic_load_explicit(&worker->buffer, memory_order_relaxed));
+    while (worker->retired)
+    {
+        struct tpool_buffer* next = worker->retired->next;
+        free(worker->retired);
+        worker->retired = next;
+    }
+    free(worker->inbox);
+    mtx_destroy(&worker->inbox_lock);
+}
+
+static void free_pool(tpool_t* pool, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++)
+        free_worker(&pool->workers[i]);
+    aligned_free(pool->workers);
+    cnd_destroy(&pool->cond);
+    mtx_destroy(&pool->lock);
+}
+
+static void stop_workers(tpool_t* pool, unsigned int count)
+{
+    mtx_lock(&pool->lock);
+    atomic_store_explicit(&pool->stopping, 1, memory_order_seq_cst);
+    cnd_broadcast(&pool->cond);
+    mtx_unlock(&pool->lock);
+    for (unsigned int i = 0; i < count; i++)
+        thrd_join(pool->workers[i].thrd, NULL);
+}
+
+void tpool_destroy(tpool_t* pool)
+{
+    stop_workers(pool, pool->count);
+    free_pool(pool, pool->count);
+}
+
+int tpool_init(tpool_t* pool, unsigned int count)
+{
+    memset(pool, 0, sizeof(*pool));
+    if (count == 0)
+        count = thrd_processor_count();
+    size_t nbtotal = count * sizeof(struct tpool_worker);
+    pool->workers = aligned_alloc(CACHELINE_SIZE, nbtotal);
+    if (pool->workers == NULL)
+        return thrd_nomem;
+    memset(pool->workers, 0, nbtotal);
+    if (mtx_init(&pool->lock, mtx_plain) != thrd_success)
+    {
+        aligned_free(pool->workers);
+        return thrd_error;
+    }
+    if (cnd_init(&pool->cond) != thrd_success)
+    {
+        mtx_destroy(&pool->lock);
+        aligned_free(pool->workers);
+        return thrd_error;
+    }
+    int res = thrd_success;
+    unsigned int i = 0;
+    for (; i < count; i++)
+    {
+        res = init_worker(pool, &pool->workers[i], i);
+        if (res != thrd_success)
+        {
+            free_pool(pool, i);
+            return res;
+        }
+    }
+    pool->count = count;
+    for (i = 0; i < count; i++)
+    {
+        res = thrd_create(&pool->workers[i].thrd, worker_main
+            , &pool->workers[i]);
+        if (res != thrd_success)
+        {
+            stop_workers(pool, i);
+            free_pool(pool, count);
+            return res;
+        }
+    }
+    return thrd_success;
+}
+
+int tpool_submit(tpool_t* pool, thrd_start_t func, void* arg)
+{
+    struct tpool_worker* worker = t_worker;
+    int res = thrd_success;
+    if (worker && worker->pool == pool)
+    {
+        res = push(worker, func, arg);
+    }
+    else
+    {
+        unsigned int next = atomic_fetch_add_explicit(&pool->next, 1
+            , memory_order_relaxed);
+        res = post(&pool->workers[next % pool->count], func, arg);
+    }
+    if (res == thrd_success)
+        wake_one(pool);
+    return res;
+}
+
+/*
+ *  Parallel loops: chunks are claimed with a fetch-and-add on
+ *  next and counted in done, the last one signals the caller.
+ *  Helpers may start only after the loop is over, so the loop
+ *  is reference counted and freed by whoever leaves it last.
+ */
+
+struct tpool_loop
+{
+    atomic_size_t next;
+    atomic_size_t done;
+    atomic_uint refs;
+    int finished;
+    mtx_t lock;
+    cnd_t cond;
+    size_t begin;
+    size_t end;
+    size_t grain;
+    size_t chunks;
+    size_t stride;
+    unsigned char* partials;
+    tpool_for_t func;
+    tpool_map_t map;
+    void* arg;
+};
+
+static size_t chunk_count(tpool_t* pool, size_t begin, size_t end
+    , size_t* grain)
+{
+    size_t count = end - begin;
+    if (*grain == 0)
+    {
+        *grain = count / (4 * (pool->count + 1));
+        *grain = (*grain > 0) ? *grain : 1;
+    }
+    return (count + *grain - 1) / *grain;
+}
+
+static void release_loop(struct tpool_loop* loop)
+{
+    if (atomic_fetch_sub_explicit(&loop->refs, 1
+        , memory_order_acq_rel) != 1)
+        return;
+    cnd_destroy(&loop->cond);
+    mtx_destroy(&loop->lock);
+    free(loop);
+}
+
+static void run_chunks(struct tpool_loop* loop)
+{
+    for (;;)
+    {
+        size_t chunk = atomic_fetch_add_explicit(&loop->next, 1
+            , memory_order_relaxed);
+        if (chunk >= loop->chunks)
+            break;
+        size_t begin = loop->begin + chunk * loop->grain;
+        size_t end = (loop->end - begin > loop->grain)
+            ? begin + loop->grain : loop->end;
+        if (loop->func)
+            loop->func(begin, end, loop->arg);
+        else
+            loop->map(begin, end, loop->partials + chunk * loop->stride
+                , loop->arg);
+        if (atomic_fetch_add_explicit(&loop->done, 1
+            , memory_order_acq_rel) + 1 == loop->chunks)
+        {
+            mtx_lock(&loop->lock);
+            loop->finished = 1;
+            cnd_broadcast(&loop->cond);
+            mtx_unlock(&loop->lock);
+        }
+    }
+}
+
+static int loop_helper(void* arg)
+{
+    struct tpool_loop* loop = arg;
+    run_chunks(loop);
+    release_loop(loop);
+    return 0;
+}
+
+static int run_loop(tpool_t* pool, size_t begin, size_t end, size_t grain
+    , size_t chunks, tpool_for_t func, tpool_map_t map
+    , unsigned char* partials, size_t stride, void* arg)
+{
+    struct tpool_loop* loop = malloc(sizeof(*loop));
+    if (loop == NULL)
+        return thrd_nomem;
+    memset(loop, 0, sizeof(*loop));
+    if (mtx_init(&loop->lock, mtx_plain) != thrd_success)
+    {
+        free(loop);
+        return thrd_error;
+    }
+    if (cnd_init(&loop->cond) != thrd_success)
+    {
+        mtx_destroy(&loop->lock);
+        free(loop);
+        return thrd_error;
+    }
+    atomic_init(&loop->refs, 1);
+    loop->begin = begin;
+    loop->end = end;
+    loop->grain = grain;
+    loop->chunks = chunks;
+    loop->stride = stride;
+    loop->partials = partials;
+    loop->func = func;
+    loop->map = map;
+    loop->arg = arg;
+    size_t helpers = (chunks - 1 < pool->count) ? chunks - 1 : pool->count;
+    for (size_t i = 0; i < helpers; i++)
+    {
+        atomic_fetch_add_explicit(&loop->refs, 1, memory_order_relaxed);
+        if (tpool_submit(pool, loop_helper, loop) != thrd_success)
+        {
+            atomic_fetch_sub_explicit(&loop->refs, 1, memory_order_relaxed);
+            break;
+        }
+    }
+    run_chunks(loop);
+    mtx_lock(&loop->lock);
+    while (!loop->finished)
+        cnd_wait(&loop->cond, &loop->lock);
+    mtx_unlock(&loop->lock);
+    release_loop(loop);
+    return thrd_success;
+}
+
+/*
+ *  Partials get a cache line each, plus one for scratch space
+ */
+
+static unsigned char* alloc_partials(size_t chunks, size_t size
+    , size_t* stride, const void* identity)
+{
+    *stride = (size + CACHELINE_SIZE - 1) / CACHELINE_SIZE * CACHELINE_SIZE;
+    unsigned char* partials = aligned_alloc(CACHELINE_SIZE
+        , (chunks + 1) * *stride);
+    if (partials)
+    {
+        for (size_t i = 0; i < chunks; i++)
+            memcpy(partials + i * *stride, identity, size);
+    }
+    return partials;
+}
+
+int parallel_for(tpool_t* pool, size_t begin, size_t end, size_t grain
+    , tpool_for_t func, void* arg)
+{
+    if (begin >= end)
+        return thrd_success;
+    size_t chunks = chunk_count(pool, begin, end, &grain);
+    if (chunks == 1 || pool->count == 0)
+    {
+        func(begin, end, arg);
+        return thrd_success;
+    }
+    return run_loop(pool, begin, end, grain, chunks, func, NULL, NULL, 0
+        , arg);
+}
+
+int parallel_reduce(tpool_t* pool, size_t begin, size_t end, size_t grain
+    , void* result, size_t size, tpool_map_t map, tpool_combine_t combine
+    , void* arg)
+{
+    if (begin >= end)
+        return thrd_success;
+    size_t chunks = chunk_count(pool, begin, end, &grain);
+    if (chunks == 1 || pool->count == 0)
+    {
+        map(begin, end, result, arg);
+        return thrd_success;
+    }
+    size_t stride = 0;
+    unsigned char* partials = alloc_partials(chunks, size, &stride, result);
+    if (partials == NULL)
+        return thrd_nomem;
+    int res = run_loop(pool, begin, end, grain, chunks, NULL, map
+        , partials, stride, arg);
+    if (res == thrd_success)
+    {
+        for (size_t i = 0; i < chunks; i++)
+            combine(result, partials + i * stride, arg);
+    }
+    aligned_free(partials);
+    return res;
+}
+
+int parallel_scan(tpool_t* pool, size_t begin, size_t end, size_t grain
+    , void* total, size_t size, tpool_map_t reduce, tpool_map_t scan
+    , tpool_combine_t combine, void* arg)
+{
+    if (begin >= end)
+        return thrd_success;
+    size_t chunks = chunk_count(pool, begin, end, &grain);
+    if (pool->count == 0)
+        chunks = 1;
+    size_t stride = 0;
+    unsigned char* partials = alloc_partials(chunks, size, &stride, total);
+    if (partials == NULL)
+        return thrd_nomem;
+    if (chunks == 1)
+    {
+        /*
+         *  Still two passes, so that total comes from reduce no
+         *  matter how many chunks there are.
+         */
+        reduce(begin, end, total, arg);
+        scan(begin, end, partials, arg);
+        aligned_free(partials);
+        return thrd_success;
+    }
+    int res = run_loop(pool, begin, end, grain, chunks, NULL, reduce
+        , partials, stride, arg);
+    if (res == thrd_success)
+    {
+        unsigned char* prefix = partials + chunks * stride;
+        for (size_t i = 0; i < chunks; i++)
+        {
+            memcpy(prefix, total, size);
+            combine(total, partials + i * stride, arg);
+            memcpy(partials + i * stride, prefix, size);
+        }
+        res = run_loop(pool, begin, end, grain, chunks, NULL, scan
+            , partials, stride, arg);
+    }
+    aligned_free(partials);
+    return res;
+}
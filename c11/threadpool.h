@@ -0,0 +1,101 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <c11/_cdefs.h>
+#include <stddef.h>
+#include <c11/stdatomic.h>
+#include <c11/threads.h>
+
+/*
+ *  Work-stealing thread pool (non-standard)
+ *
+ *  Every worker owns a Chase-Lev deque: tasks submitted by a
+ *  worker are pushed onto (and popped from) the bottom of its
+ *  own deque, idle workers steal from the top of a randomly
+ *  chosen victim. Tasks submitted by other threads go to the
+ *  inbox of a worker (round robin). Workers that run out of
+ *  work park on a condition variable.
+ */
+
+#if !defined(CACHELINE_SIZE)
+#   define CACHELINE_SIZE 64
+#endif /* !defined(CACHELINE_SIZE) */
+
+struct tpool_worker;
+
+typedef struct
+{
+    struct tpool_worker* workers;
+    unsigned int count;
+    atomic_uint next;
+    atomic_uint sleepers;
+    atomic_int stopping;
+    mtx_t lock;
+    cnd_t cond;
+} tpool_t;
+
+/*
+ *  tpool_init starts count workers, or one per processor if
+ *  count is 0. tpool_destroy runs all tasks still queued (and
+ *  the ones they submit) before it joins the workers.
+ */
+
+void tpool_destroy(tpool_t* pool);
+
+int tpool_init(tpool_t* pool, unsigned int count);
+
+/*
+ *  The return value of func is ignored.
+ */
+
+int tpool_submit(tpool_t* pool, thrd_start_t func, void* arg);
+
+/*
+ *  Parallel loops
+ *
+ *  The range [begin, end) is split into chunks of grain indices
+ *  (by default about four per thread), which the calling thread
+ *  and the workers of pool claim one at a time. The functions
+ *  return once all chunks are done.
+ *
+ *  parallel_reduce: result holds the identity of combine (of
+ *  size bytes) on entry. map accumulates the chunk [begin, end)
+ *  into partial, which starts out as a copy of the identity,
+ *  combine(lhs, rhs) stores lhs op rhs in lhs. The partials are
+ *  combined in index order, so op has to be associative, but
+ *  not necessarily commutative.
+ *
+ *  parallel_scan: in a first pass reduce accumulates the chunk
+ *  [begin, end) into partial (like parallel_reduce). In the
+ *  second pass scan is called with partial holding the value
+ *  of all indices before begin, it writes the prefixes of the
+ *  chunk and may update partial as it goes. total is treated
+ *  like the result of parallel_reduce.
+ */
+
+typedef void (*tpool_for_t)(size_t begin, size_t end, void* arg);
+
+typedef void (*tpool_map_t)(size_t begin, size_t end, void* partial
+    , void* arg);
+
+typedef void (*tpool_combine_t)(void* lhs, const void* rhs, void* arg);
+
+int parallel_for(tpool_t* pool, size_t begin, size_t end, size_t grain
+    , tpool_for_t func, void* arg);
+
+int parallel_reduce(tpool_t* pool, size_t begin, size_t end, size_t grain
+    , void* result, size_t size, tpool_map_t map, tpool_combine_t combine
+    , void* arg);
+
+int parallel_scan(tpool_t* pool, size_t begin, size_t end, size_t grain
+    , void* total, size_t size, tpool_map_t reduce, tpool_map_t scan
+    , tpool_combine_t combine, void* arg);
+
+#endif /* __THREADPOOL_H__ */
@@ -5,703 +5,2803 @@
  *  (http://www.boost.org/LICENSE_1_0.txt)
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
 #include <c11/threads.h>
 
-#if defined(HAVE_THREADS_H_WORKAROUND)
+#if !defined(HAVE_THREADS_H)
 
 #include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <c11/aligned_alloc.h>
 
-#if defined(HAVE_POSIX_THREADS) && !defined(HAVE_TIMEDLOCK)
+/*
+ *  mtx_adaptive spins for about twice as many iterations as
+ *  recent acquisitions needed (like glibc's adaptive mutexes),
+ *  bounded by MTX_SPIN_LIMIT. Spinning in vain makes the
+ *  estimate decay, so long critical sections stop spinning.
+ */
 
-#if defined(__APPLE__)
-#   include <pthread_spis.h>
-#endif /* defined(__APPLE__) */
+static inline int spin_limit(int spins)
+{
+    int limit = spins * 2 + 10;
+    return (limit < MTX_SPIN_LIMIT) ? limit : MTX_SPIN_LIMIT;
+}
 
-#define INVALID_THRDID ((pthread_t)-1)
+static inline int spin_update(int spins, int count, int acquired)
+{
+    if (acquired)
+        return spins + (count - spins) / 8;
+    return spins - spins / 8;
+}
+
+#if !defined(HAVE_FUTEX) && !defined(HAVE_CLOCKWAIT)
+
+/*
+ *  Deadlines are measured against the clock of their time base
+ *  (TIME_UTC or TIME_MONOTONIC).
+ */
+
+static long long nsec_until(int base, const struct timespec* ts)
+{
+    struct timespec now = { 0 };
+    timespec_get(&now, base);
+    long long diff = (ts->tv_sec - now.tv_sec) * 1000000000LL
+        + (ts->tv_nsec - now.tv_nsec);
+    return (diff > 0) ? diff : 0;
+}
+
+#endif /* !defined(HAVE_FUTEX) ... */
+
+#if defined(HAVE_WINDOWS_THREADS)
+
+static DWORD deadline_to_msec(int base, const struct timespec* ts)
+{
+    if (ts == NULL)
+        return INFINITE;
+    return (DWORD)((nsec_until(base, ts) + 999999LL) / 1000000LL);
+}
+
+#endif /* defined(HAVE_WINDOWS_THREADS) */
+
+#if defined(HAVE_POSIX_THREADS) && !defined(HAVE_FUTEX)
+
+/*
+ *  Without pthread_cond_clockwait, condition variables measure
+ *  timeouts against CLOCK_MONOTONIC where they can, so that
+ *  setting the system time doesn't stretch monotonic waits.
+ *  Darwin has relative waits instead.
+ */
+
+#if defined(HAVE_CLOCKWAIT) || defined(__APPLE__) \
+    || !defined(_POSIX_MONOTONIC_CLOCK)
+#   define COND_TIME_BASE TIME_UTC
+#else
+#   define COND_TIME_BASE TIME_MONOTONIC
+#endif /* defined(HAVE_CLOCKWAIT) ... */
+
+#if !defined(HAVE_CLOCKWAIT) && !defined(__APPLE__)
+
+static void convert_deadline(struct timespec* deadline, int base
+    , const struct timespec* ts, int target)
+{
+    if (base == target)
+    {
+        *deadline = *ts;
+        return;
+    }
+    long long nsec = nsec_until(base, ts);
+    timespec_get(deadline, target);
+    nsec += deadline->tv_nsec;
+    deadline->tv_sec += (time_t)(nsec / 1000000000LL);
+    deadline->tv_nsec = (long)(nsec % 1000000000LL);
+}
+
+#endif /* !defined(HAVE_CLOCKWAIT) ... */
+
+static int cond_init(pthread_cond_t* cond)
+{
+#if COND_TIME_BASE == TIME_MONOTONIC
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int res = pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+    return res;
+#else
+    return pthread_cond_init(cond, NULL);
+#endif /* COND_TIME_BASE == TIME_MONOTONIC */
+}
+
+static int cond_clockwait(pthread_cond_t* cond, pthread_mutex_t* mtx
+    , int base, const struct timespec* ts)
+{
+    if (ts == NULL)
+        return pthread_cond_wait(cond, mtx);
+#if defined(HAVE_CLOCKWAIT)
+    return pthread_cond_clockwait(cond, mtx, (base == TIME_MONOTONIC)
+        ? CLOCK_MONOTONIC : CLOCK_REALTIME, ts);
+#elif defined(__APPLE__)
+    long long nsec = nsec_until(base, ts);
+    struct timespec rel = { (time_t)(nsec / 1000000000LL)
+        , (long)(nsec % 1000000000LL) };
+    return pthread_cond_timedwait_relative_np(cond, mtx, &rel);
+#else
+    struct timespec deadline = { 0 };
+    convert_deadline(&deadline, base, ts, COND_TIME_BASE);
+    return pthread_cond_timedwait(cond, mtx, &deadline);
+#endif /* defined(HAVE_CLOCKWAIT) */
+}
+
+#endif /* defined(HAVE_POSIX_THREADS) && !defined(HAVE_FUTEX) */
+
+#if defined(HAVE_FUTEX)
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/*
+ *  FUTEX_WAIT_BITSET takes an absolute timeout (FUTEX_WAIT
+ *  a relative one), which is exactly what C11 hands us. It's
+ *  measured against CLOCK_MONOTONIC unless FUTEX_CLOCK_REALTIME
+ *  is given.
+ */
+
+static inline int futex_clockwait(atomic_uint* addr, unsigned int val
+    , int base, const struct timespec* ts)
+{
+    int op = FUTEX_WAIT_BITSET_PRIVATE;
+    if (base != TIME_MONOTONIC)
+        op |= FUTEX_CLOCK_REALTIME;
+    if (syscall(SYS_futex, addr, op, val, ts, NULL
+        , FUTEX_BITSET_MATCH_ANY) == 0)
+        return 0;
+    return errno;
+}
+
+static inline void futex_wake(atomic_uint* addr, int count)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+/*
+ *  Wakes up to count threads waiting on addr and moves up to
+ *  requeue of the remaining ones over to addr2, provided addr
+ *  still holds val.
+ */
+
+static inline int futex_requeue(atomic_uint* addr, unsigned int val
+    , int count, int requeue, atomic_uint* addr2)
+{
+    if (syscall(SYS_futex, addr, FUTEX_CMP_REQUEUE_PRIVATE, count
+        , (void*)(intptr_t)requeue, addr2, val) >= 0)
+        return 0;
+    return errno;
+}
+
+#elif defined(HAVE_WAIT_ON_ADDRESS)
+
+#if defined(_MSC_VER)
+#   pragma comment(lib, "synchronization.lib")
+#endif /* defined(_MSC_VER) */
+
+/*
+ *  WaitOnAddress (Windows 8 and later) is the closest thing to a
+ *  futex, it returns right away if addr doesn't hold val.
+ */
+
+static int futex_clockwait(atomic_uint* addr, unsigned int val
+    , int base, const struct timespec* ts)
+{
+    if (WaitOnAddress((volatile VOID*)addr, &val, sizeof(val)
+        , deadline_to_msec(base, ts)))
+        return 0;
+    return (GetLastError() == ERROR_TIMEOUT) ? ETIMEDOUT : EINVAL;
+}
+
+static void futex_wake(atomic_uint* addr, int count)
+{
+    if (count == 1)
+        WakeByAddressSingle((PVOID)addr);
+    else
+        WakeByAddressAll((PVOID)addr);
+}
+
+#else
+
+/*
+ *  Without futexes, threads park in a small table of lock and
+ *  condition variable pairs hashed by address. futex_wake
+ *  notifies the whole bucket, so callers have to put up with
+ *  spurious wakeups (just like with the real thing).
+ */
+
+#define PARKING_LOT_BITS 6
+
+struct parking_bucket
+{
+#if defined(HAVE_POSIX_THREADS)
+    _Alignas(CACHELINE_SIZE) pthread_mutex_t lock;
+    pthread_cond_t cond;
+#elif defined(HAVE_WINDOWS_THREADS)
+    _Alignas(CACHELINE_SIZE) SRWLOCK lock;
+    CONDITION_VARIABLE cond;
+#endif /* defined(HAVE_POSIX_THREADS) */
+    unsigned int waiters;
+};
+
+static struct parking_bucket g_parking_lot[1 << PARKING_LOT_BITS];
+
+#if defined(HAVE_POSIX_THREADS)
+
+/*
+ *  call_once waits on the parking lot itself
+ */
+
+static pthread_once_t g_parking_lot_once = PTHREAD_ONCE_INIT;
+
+static void init_parking_lot(void)
+{
+    for (size_t i = 0; i < (1 << PARKING_LOT_BITS); i++)
+    {
+        pthread_mutex_init(&g_parking_lot[i].lock, NULL);
+        cond_init(&g_parking_lot[i].cond);
+    }
+}
+
+#endif /* defined(HAVE_POSIX_THREADS) */
+
+static struct parking_bucket* lock_bucket(void* addr)
+{
+    uint32_t hash = (uint32_t)((uintptr_t)addr >> 2) * 2654435769U;
+    struct parking_bucket* bucket
+        = &g_parking_lot[hash >> (32 - PARKING_LOT_BITS)];
+#if defined(HAVE_POSIX_THREADS)
+    pthread_once(&g_parking_lot_once, init_parking_lot);
+    pthread_mutex_lock(&bucket->lock);
+#elif defined(HAVE_WINDOWS_THREADS)
+    AcquireSRWLockExclusive(&bucket->lock);
+#endif /* defined(HAVE_POSIX_THREADS) */
+    return bucket;
+}
+
+static void unlock_bucket(struct parking_bucket* bucket)
+{
+#if defined(HAVE_POSIX_THREADS)
+    pthread_mutex_unlock(&bucket->lock);
+#elif defined(HAVE_WINDOWS_THREADS)
+    ReleaseSRWLockExclusive(&bucket->lock);
+#endif /* defined(HAVE_POSIX_THREADS) */
+}
+
+static int futex_clockwait(atomic_uint* addr, unsigned int val
+    , int base, const struct timespec* ts)
+{
+    struct parking_bucket* bucket = lock_bucket(addr);
+    int res = EAGAIN;
+    if (atomic_load_explicit(addr, memory_order_relaxed) == val)
+    {
+        bucket->waiters++;
+#if defined(HAVE_POSIX_THREADS)
+        res = cond_clockwait(&bucket->cond, &bucket->lock, base, ts);
+#elif defined(HAVE_WINDOWS_THREADS)
+        res = 0;
+        if (!SleepConditionVariableSRW(&bucket->cond, &bucket->lock
+            , deadline_to_msec(base, ts), 0))
+            res = (GetLastError() == ERROR_TIMEOUT) ? ETIMEDOUT : EINVAL;
+#endif /* defined(HAVE_POSIX_THREADS) */
+        bucket->waiters--;
+    }
+    unlock_bucket(bucket);
+    return res;
+}
+
+static void futex_wake(atomic_uint* addr, int count)
+{
+    (void)count;
+    struct parking_bucket* bucket = lock_bucket(addr);
+    if (bucket->waiters)
+    {
+#if defined(HAVE_POSIX_THREADS)
+        pthread_cond_broadcast(&bucket->cond);
+#elif defined(HAVE_WINDOWS_THREADS)
+        WakeAllConditionVariable(&bucket->cond);
+#endif /* defined(HAVE_POSIX_THREADS) */
+    }
+    unlock_bucket(bucket);
+}
+
+#endif /* defined(HAVE_FUTEX) */
+
+static inline int futex_wait(atomic_uint* addr, unsigned int val
+    , const struct timespec* ts)
+{
+    return futex_clockwait(addr, val, TIME_UTC, ts);
+}
+
+/*
+ *  Non-standard: the same layer for atomic_wait (stdatomic.c)
+ */
+
+void thrd_wait_address(atomic_uint* addr, unsigned int val)
+{
+    futex_wait(addr, val, NULL);
+}
+
+void thrd_wake_address(atomic_uint* addr, int all)
+{
+    futex_wake(addr, all ? INT_MAX : 1);
+}
+
+#if defined(HAVE_FUTEX)
+
+/*
+ *  mtx_fair is an MCS queue lock, in the K42 variant: the mutex
+ *  embeds the queue node of its owner (head), so waiters need
+ *  their own node only as long as they are queued. Waiters spin
+ *  on their node for a while before they park on it. Timed
+ *  waiters allocate their node, which allows them to abandon
+ *  it on timeout. The next unlock skips (and frees) it.
+ */
+
+enum
+{
+    waiter_granted,
+    waiter_spinning,
+    waiter_parked,
+    waiter_abandoned
+};
+
+static void take_over(mtx_t* mtx, struct mtx_waiter* node)
+{
+    struct mtx_waiter* next = atomic_load_explicit(&node->next
+        , memory_order_acquire);
+    if (next == NULL)
+    {
+        struct mtx_waiter* expected = node;
+        atomic_store_explicit(&mtx->head.next, NULL, memory_order_relaxed);
+        if (atomic_compare_exchange_strong_explicit(&mtx->tail, &expected
+            , &mtx->head, memory_order_acq_rel, memory_order_relaxed))
+            return;
+        while ((next = atomic_load_explicit(&node->next
+            , memory_order_acquire)) == NULL)
+            thrd_cpu_relax();
+    }
+    atomic_store_explicit(&mtx->head.next, next, memory_order_relaxed);
+}
+
+static int wait_fair(struct mtx_waiter* node, int base
+    , const struct timespec* ts)
+{
+    for (int i = 0; i < MTX_SPIN_LIMIT; i++)
+    {
+        if (atomic_load_explicit(&node->state
+            , memory_order_acquire) == waiter_granted)
+            return thrd_success;
+        thrd_cpu_relax();
+    }
+    unsigned int state = waiter_spinning;
+    if (!atomic_compare_exchange_strong_explicit(&node->state, &state
+        , waiter_parked, memory_order_acquire, memory_order_acquire))
+        return thrd_success;
+    for (;;)
+    {
+        int res = futex_clockwait(&node->state, waiter_parked, base, ts);
+        if (atomic_load_explicit(&node->state
+            , memory_order_acquire) == waiter_granted)
+            return thrd_success;
+        if (res == ETIMEDOUT || res == EINVAL)
+        {
+            state = waiter_parked;
+            if (!atomic_compare_exchange_strong_explicit(&node->state
+                , &state, waiter_abandoned, memory_order_acq_rel
+                , memory_order_acquire))
+                return thrd_success;
+            return (res == ETIMEDOUT) ? thrd_timedout : thrd_error;
+        }
+    }
+}
+
+static int trylock_fair(mtx_t* mtx)
+{
+    struct mtx_waiter* expected = NULL;
+    return atomic_compare_exchange_strong_explicit(&mtx->tail, &expected
+        , &mtx->head, memory_order_acquire, memory_order_relaxed);
+}
+
+static int lock_fair(mtx_t* mtx, int base, const struct timespec* ts)
+{
+    if (trylock_fair(mtx))
+        return thrd_success;
+    struct mtx_waiter local;
+    struct mtx_waiter* node = &local;
+    if (ts)
+    {
+        node = malloc(sizeof(*node));
+        if (node == NULL)
+            return thrd_error;
+    }
+    atomic_init(&node->next, NULL);
+    atomic_init(&node->state, waiter_spinning);
+    struct mtx_waiter* prev = atomic_exchange_explicit(&mtx->tail, node
+        , memory_order_acq_rel);
+    if (prev)
+    {
+        atomic_store_explicit(&prev->next, node, memory_order_release);
+        int res = wait_fair(node, base, ts);
+        if (res != thrd_success)
+            return res;
+    }
+    take_over(mtx, node);
+    if (node != &local)
+        free(node);
+    return thrd_success;
+}
+
+static void unlock_fair(mtx_t* mtx)
+{
+    for (;;)
+    {
+        struct mtx_waiter* next = atomic_load_explicit(&mtx->head.next
+            , memory_order_acquire);
+        if (next == NULL)
+        {
+            struct mtx_waiter* expected = &mtx->head;
+            if (atomic_compare_exchange_strong_explicit(&mtx->tail
+                , &expected, NULL, memory_order_release
+                , memory_order_relaxed))
+                return;
+            while ((next = atomic_load_explicit(&mtx->head.next
+                , memory_order_acquire)) == NULL)
+                thrd_cpu_relax();
+        }
+        unsigned int state = atomic_exchange_explicit(&next->state
+            , waiter_granted, memory_order_acq_rel);
+        if (state == waiter_parked)
+            futex_wake(&next->state, 1);
+        if (state != waiter_abandoned)
+            return;
+        take_over(mtx, next);
+        free(next);
+    }
+}
+
+#endif /* defined(HAVE_FUTEX) */
+
+/*
+ *  7.26.2 Initialization functions
+ */
+
+int call_once_begin(once_flag* flag)
+{
+    unsigned int state = 0;
+    if (atomic_compare_exchange_strong_explicit(&flag->state, &state
+        , ONCE_RUNNING, memory_order_acquire, memory_order_acquire))
+        return 1;
+    while (state != ONCE_DONE)
+    {
+        if (state == ONCE_RUNNING
+            && !atomic_compare_exchange_weak_explicit(&flag->state
+                , &state, ONCE_RUNNING | ONCE_WAITERS
+                , memory_order_acquire, memory_order_acquire))
+            continue;
+        futex_wait(&flag->state, ONCE_RUNNING | ONCE_WAITERS, NULL);
+        state = atomic_load_explicit(&flag->state, memory_order_acquire);
+    }
+    return 0;
+}
+
+void call_once_end(once_flag* flag)
+{
+    if (atomic_exchange_explicit(&flag->state, ONCE_DONE
+        , memory_order_release) & ONCE_WAITERS)
+        futex_wake(&flag->state, INT_MAX);
+}
+
+#if defined(HAVE_FUTEX)
+
+#if defined(C11_THREADS_STATS)
+
+/*
+ *  Registry of all initialized mutexes and condition variables
+ */
+
+static mtx_t g_stats_lock;
+static struct thrd_stats* g_stats;
+
+static unsigned long long stats_now(void)
+{
+    struct timespec now = { 0 };
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int stats_bucket(unsigned long long nsec)
+{
+    int bucket = 0;
+    while ((nsec >>= 1) != 0 && bucket < THRD_STATS_BUCKETS - 1)
+        bucket++;
+    return bucket;
+}
+
+static void stats_max(atomic_ullong* counter, unsigned long long value)
+{
+    unsigned long long prev = atomic_load_explicit(counter
+        , memory_order_relaxed);
+    while (value > prev && !atomic_compare_exchange_weak_explicit(counter
+        , &prev, value, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+/*
+ *  Records a wait that ended with the mutex being acquired. The
+ *  waiters of a cnd_t may hold different mutexes, so the counters
+ *  need atomic read-modify-writes.
+ */
+
+static unsigned long long stats_waited(struct thrd_stats* stats
+    , unsigned long long start)
+{
+    unsigned long long now = stats_now();
+    unsigned long long wait = now - start;
+    atomic_fetch_add_explicit(&stats->contended, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->wait_total, wait
+        , memory_order_relaxed);
+    stats_max(&stats->wait_max, wait);
+    atomic_fetch_add_explicit(&stats->wait_hist[stats_bucket(wait)], 1
+        , memory_order_relaxed);
+    return now;
+}
+
+void thrd_stats_register(struct thrd_stats* stats, const void* lock
+    , int kind)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->lock = lock;
+    stats->kind = kind;
+    mtx_lock(&g_stats_lock);
+    stats->next = g_stats;
+    if (g_stats)
+        g_stats->prev = stats;
+    g_stats = stats;
+    mtx_unlock(&g_stats_lock);
+}
+
+void thrd_stats_unregister(struct thrd_stats* stats)
+{
+    mtx_lock(&g_stats_lock);
+    if (stats->prev || g_stats == stats)
+    {
+        if (stats->prev)
+            stats->prev->next = stats->next;
+        else
+            g_stats = stats->next;
+        if (stats->next)
+            stats->next->prev = stats->prev;
+        stats->next = NULL;
+        stats->prev = NULL;
+    }
+    mtx_unlock(&g_stats_lock);
+}
+
+void thrd_stats_unlocked(struct thrd_stats* stats)
+{
+    unsigned long long hold = stats_now() - stats->hold_start;
+    stats->hold_start = 0;
+    thrd_stats_add(&stats->hold_hist[stats_bucket(hold)], 1);
+}
+
+#endif /* defined(C11_THREADS_STATS) */
+
+/*
+ *  7.26.3 Condition variable functions
+ */
+
+/*
+ *  Waking the waiters of a broadcast (or cnd_signal_n) at once
+ *  just makes them pile up on the mutex again. Only one of them
+ *  is woken, the others are requeued onto the mutex word. Since
+ *  the mutex may have sleepers now, whoever leaves cnd_wait has
+ *  to lock it as contended (state 2), so that every unlock hands
+ *  the mutex to the next requeued waiter.
+ */
+
+int cnd_signal_slow(cnd_t* cond, int count)
+{
+    unsigned int seq = atomic_fetch_add_explicit(&cond->seq, 1
+        , memory_order_release) + 1;
+    mtx_t* mtx = atomic_load_explicit(&cond->mtx, memory_order_relaxed);
+    if (count == 1 || mtx == NULL || (mtx->type & mtx_fair))
+    {
+        futex_wake(&cond->seq, count);
+        return thrd_success;
+    }
+    while (futex_requeue(&cond->seq, seq, 1, count - 1
+        , &mtx->state) == EAGAIN)
+    {
+        seq = atomic_load_explicit(&cond->seq, memory_order_relaxed);
+    }
+    return thrd_success;
+}
+
+static void mtx_relock(mtx_t* mtx)
+{
+    if (mtx->type & mtx_fair)
+    {
+        lock_fair(mtx, TIME_UTC, NULL);
+        mtx_acquired(mtx);
+        return;
+    }
+    while (atomic_exchange_explicit(&mtx->state, 2
+        , memory_order_acquire) != 0)
+        futex_wait(&mtx->state, 2, NULL);
+    mtx_acquired(mtx);
+}
+
+int cnd_clockwait(cnd_t* cond, mtx_t* mtx, int base
+    , const struct timespec* ts)
+{
+#if defined(C11_THREADS_STATS)
+    unsigned long long start = stats_now();
+#endif /* defined(C11_THREADS_STATS) */
+    unsigned int seq = atomic_load_explicit(&cond->seq
+        , memory_order_relaxed);
+    atomic_fetch_add_explicit(&cond->waiters, 1, memory_order_relaxed);
+    atomic_store_explicit(&cond->mtx, mtx, memory_order_relaxed);
+    unsigned int count = mtx->count;
+    if (mtx->type & mtx_recursive)
+        mtx->count = 1;
+    mtx_unlock(mtx);
+    int res = 0;
+    do
+    {
+        res = futex_clockwait(&cond->seq, seq, base, ts);
+    }
+    while (res == EINTR);
+    atomic_fetch_sub_explicit(&cond->waiters, 1, memory_order_relaxed);
+    mtx_relock(mtx);
+    if (mtx->type & mtx_recursive)
+        mtx->count = count;
+#if defined(C11_THREADS_STATS)
+    atomic_fetch_add_explicit(&cond->stats.acquisitions, 1
+        , memory_order_relaxed);
+    stats_waited(&cond->stats, start);
+    if (res == ETIMEDOUT)
+        atomic_fetch_add_explicit(&cond->stats.timeouts, 1
+            , memory_order_relaxed);
+#endif /* defined(C11_THREADS_STATS) */
+    if (res == 0 || res == EAGAIN)
+        return thrd_success;
+    return (res == ETIMEDOUT) ? thrd_timedout : thrd_error;
+}
+
+/*
+ *  7.26.4 Mutex functions
+ */
+
+static inline int is_owner(mtx_t* mtx)
+{
+    return (mtx->type & mtx_recursive)
+        && atomic_load_explicit(&mtx->owner, memory_order_relaxed)
+            == (uintptr_t)pthread_self();
+}
+
+static int mtx_spin(mtx_t* mtx)
+{
+    int spins = atomic_load_explicit(&mtx->spins, memory_order_relaxed);
+    int limit = spin_limit(spins);
+    for (int i = 0; i < limit; i++)
+    {
+        thrd_cpu_relax();
+        unsigned int expected = 0;
+        if (atomic_load_explicit(&mtx->state, memory_order_relaxed) == 0
+            && atomic_compare_exchange_weak_explicit(&mtx->state
+                , &expected, 1, memory_order_acquire
+                , memory_order_relaxed))
+        {
+            atomic_store_explicit(&mtx->spins
+                , spin_update(spins, i, 1), memory_order_relaxed);
+            return 1;
+        }
+    }
+    atomic_store_explicit(&mtx->spins
+        , spin_update(spins, limit, 0), memory_order_relaxed);
+    return 0;
+}
+
+static int lock_contended(mtx_t* mtx, int base
+    , const struct timespec* ts)
+{
+    if (mtx->type & mtx_fair)
+    {
+        int res = lock_fair(mtx, base, ts);
+        return (res == thrd_success) ? mtx_acquired(mtx) : res;
+    }
+    if ((mtx->type & mtx_adaptive) && mtx_spin(mtx))
+        return mtx_acquired(mtx);
+    while (atomic_exchange_explicit(&mtx->state, 2
+        , memory_order_acquire) != 0)
+    {
+        int res = futex_clockwait(&mtx->state, 2, base, ts);
+        if (res == ETIMEDOUT)
+            return thrd_timedout;
+        if (res == EINVAL)
+            return thrd_error;
+    }
+    return mtx_acquired(mtx);
+}
+
+int mtx_lock_slow(mtx_t* mtx, int base, const struct timespec* ts)
+{
+    if (is_owner(mtx))
+    {
+        mtx->count++;
+        return thrd_success;
+    }
+    if ((mtx->type & mtx_fair) && trylock_fair(mtx))
+        return mtx_acquired(mtx);
+#if defined(C11_THREADS_STATS)
+    unsigned long long start = stats_now();
+    int res = lock_contended(mtx, base, ts);
+    if (res == thrd_success)
+        mtx->stats.hold_start = stats_waited(&mtx->stats, start);
+    else if (res == thrd_timedout)
+        atomic_fetch_add_explicit(&mtx->stats.timeouts, 1
+            , memory_order_relaxed);
+    return res;
+#else
+    return lock_contended(mtx, base, ts);
+#endif /* defined(C11_THREADS_STATS) */
+}
+
+int mtx_trylock_slow(mtx_t* mtx)
+{
+    if (is_owner(mtx))
+    {
+        mtx->count++;
+        return thrd_success;
+    }
+    if ((mtx->type & mtx_fair) && trylock_fair(mtx))
+        return mtx_acquired(mtx);
+#if defined(C11_THREADS_STATS)
+    atomic_fetch_add_explicit(&mtx->stats.busy, 1, memory_order_relaxed);
+#endif /* defined(C11_THREADS_STATS) */
+    return thrd_busy;
+}
+
+void mtx_unlock_slow(mtx_t* mtx)
+{
+    if (mtx->type & mtx_fair)
+    {
+        unlock_fair(mtx);
+        return;
+    }
+    atomic_store_explicit(&mtx->state, 0, memory_order_release);
+    futex_wake(&mtx->state, 1);
+}
+
+#elif defined(HAVE_POSIX_THREADS)
+
+/*
+ *  7.26.3 Condition variable functions
+ */
+
+int cnd_init(cnd_t* cond)
+{
+    int res = cond_init(cond);
+    if (res == 0)
+        return thrd_success;
+    return (res == ENOMEM) ? thrd_nomem : thrd_error;
+}
+
+#if !defined(HAVE_TIMEDLOCK)
+
+#define INVALID_THRDID ((pthread_t)-1)
+
+/*
+ *  A timed mutex is held through its locked flag, not through
+ *  its inner pthread mutex, which is what the condition variable
+ *  releases. The waiter takes the inner mutex before it clears
+ *  the flag, so nobody can lock the mutex and signal in between.
+ */
+
+static int cnd_clockwait_timed(cnd_t* cond, mtx_t* mtx, int base
+    , const struct timespec* ts)
+{
+    unsigned count = mtx->count;
+    pthread_mutex_lock(&mtx->mtx);
+    mtx->count = 0;
+    mtx->thrdid = INVALID_THRDID;
+    mtx->locked = 0;
+    pthread_cond_signal(&mtx->cond);
+    int res = cond_clockwait(cond, &mtx->mtx, base, ts);
+    while (mtx->locked)
+        pthread_cond_wait(&mtx->cond, &mtx->mtx);
+    mtx->locked = 1;
+    pthread_mutex_unlock(&mtx->mtx);
+    mtx->thrdid = pthread_self();
+    mtx->count = count;
+    return res;
+}
+
+#endif /* !defined(HAVE_TIMEDLOCK) */
+
+int cnd_clockwait(cnd_t* cond, mtx_t* mtx, int base
+    , const struct timespec* ts)
+{
+#if defined(HAVE_TIMEDLOCK)
+    int res = cond_clockwait(cond, &mtx->mtx, base, ts);
+#else
+    int res = (mtx->type & mtx_timed)
+        ? cnd_clockwait_timed(cond, mtx, base, ts)
+        : cond_clockwait(cond, &mtx->mtx, base, ts);
+#endif /* defined(HAVE_TIMEDLOCK) */
+    if (res == 0)
+        return thrd_success;
+    return (res == ETIMEDOUT) ? thrd_timedout : thrd_error;
+}
+
+/*
+ *  7.26.4 Mutex functions
+ */
+
+#if defined(HAVE_TIMEDLOCK)
+
+int mtx_clocklock(mtx_t* mtx, int base, const struct timespec* ts)
+{
+#if defined(HAVE_CLOCKWAIT)
+    int res = pthread_mutex_clocklock(&mtx->mtx, (base == TIME_MONOTONIC)
+        ? CLOCK_MONOTONIC : CLOCK_REALTIME, ts);
+#else
+    struct timespec deadline = { 0 };
+    convert_deadline(&deadline, base, ts, TIME_UTC);
+    int res = pthread_mutex_timedlock(&mtx->mtx, &deadline);
+#endif /* defined(HAVE_CLOCKWAIT) */
+    if (res == 0)
+        return thrd_success;
+    return (res == ETIMEDOUT) ? thrd_timedout : thrd_error;
+}
+
+#else
+
+#if defined(__APPLE__)
+#   include <pthread_spis.h>
+#endif /* defined(__APPLE__) */
+
+void mtx_destroy(mtx_t* mtx)
+{
+    assert(mtx->count == 0);
+    pthread_mutex_destroy(&mtx->mtx);
+    if (mtx->type & mtx_timed)
+        pthread_cond_destroy(&mtx->cond);
+}
+
+int mtx_init(mtx_t* mtx, int type)
+{
+    memset(mtx, 0, sizeof(*mtx));
+    if (type & mtx_fair)
+        return thrd_error;
+    mtx->type = type;
+    int res = 0;
+    if (type & mtx_timed)
+    {
+        res = cond_init(&mtx->cond);
+        if (res)
+            return (res == ENOMEM) ? thrd_nomem : thrd_error;
+#if defined(__APPLE__)
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpolicy_np(&attr
+            , _PTHREAD_MUTEX_POLICY_FIRSTFIT);
+        res = pthread_mutex_init(&mtx->mtx, &attr);
+        pthread_mutexattr_destroy(&attr);
+#else
+        res = pthread_mutex_init(&mtx->mtx, NULL);
+#endif /* defined(__APPLE__) */
+        if (res)
+            pthread_cond_destroy(&mtx->cond);
+        mtx->thrdid = INVALID_THRDID;
+    }
+    else if (type & mtx_recursive)
+    {
+        pthread_mutexattr_t attr = { 0 };
+        pthread_mutexattr_init(&attr);
+#if defined(__APPLE__)
+        pthread_mutexattr_setpolicy_np(&attr
+            , _PTHREAD_MUTEX_POLICY_FIRSTFIT);
+#endif /* defined(__APPLE__) */
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        res = pthread_mutex_init(&mtx->mtx, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+    else
+    {
+        res = pthread_mutex_init(&mtx->mtx, NULL);
+    }
+    if (res == 0)
+        return thrd_success;
+    return (res == ENOMEM) ? thrd_nomem : thrd_error;
+}
+
+static inline int handle_recursion(mtx_t* mtx)
+{
+    if (mtx->count++ == 0)
+    {
+        mtx->thrdid = pthread_self();
+    }
+    else if (!(mtx->type & mtx_recursive))
+    {
+        mtx->count--;
+        return thrd_error;
+    }
+    return thrd_success;
+}
+
+/*
+ *  Spin phase of mtx_adaptive mutexes, on success the mutex
+ *  has been acquired by mtx_trylock.
+ */
+
+static int mtx_spin(mtx_t* mtx)
+{
+    int spins = mtx->spins;
+    int limit = spin_limit(spins);
+    for (int i = 0; i < limit; i++)
+    {
+        if (mtx_trylock(mtx) == thrd_success)
+        {
+            mtx->spins = spin_update(spins, i, 1);
+            return 1;
+        }
+        thrd_cpu_relax();
+    }
+    mtx->spins = spin_update(spins, limit, 0);
+    return 0;
+}
+
+int mtx_lock(mtx_t* mtx)
+{
+    if ((mtx->type & mtx_adaptive) && mtx_spin(mtx))
+        return thrd_success;
+    if (mtx->type & mtx_timed)
+    {
+        if (!pthread_equal(mtx->thrdid, pthread_self()))
+        {
+            pthread_mutex_lock(&mtx->mtx);
+            while (mtx->locked)
+                pthread_cond_wait(&mtx->cond, &mtx->mtx);
+            mtx->locked = 1;
+            pthread_mutex_unlock(&mtx->mtx);
+        }
+        return handle_recursion(mtx);
+    }
+    if (pthread_mutex_lock(&mtx->mtx) == 0)
+        return thrd_success;
+    return thrd_error;
+}
+
+int mtx_clocklock(mtx_t* mtx, int base, const struct timespec* ts)
+{
+    if (!(mtx->type & mtx_timed))
+        return thrd_error;
+    if ((mtx->type & mtx_adaptive) && mtx_spin(mtx))
+        return thrd_success;
+    if (!pthread_equal(mtx->thrdid, pthread_self()))
+    {
+        pthread_mutex_lock(&mtx->mtx);
+        while (mtx->locked)
+        {
+            int res = cond_clockwait(&mtx->cond, &mtx->mtx, base, ts);
+            if (res)
+            {
+                pthread_mutex_unlock(&mtx->mtx);
+                return (res == ETIMEDOUT) ? thrd_timedout : thrd_error;
+            }
+        }
+        mtx->locked = 1;
+        pthread_mutex_unlock(&mtx->mtx);
+    }
+    return handle_recursion(mtx);
+}
+
+int mtx_timedlock(mtx_t* mtx, const struct timespec* ts)
+{
+    return mtx_clocklock(mtx, TIME_UTC, ts);
+}
+
+int mtx_trylock(mtx_t* mtx)
+{
+    if (mtx->type & mtx_timed)
+    {
+        if (!pthread_equal(mtx->thrdid, pthread_self()))
+        {
+            pthread_mutex_lock(&mtx->mtx);
+            if (mtx->locked)
+            {
+                pthread_mutex_unlock(&mtx->mtx);
+                return thrd_busy;
+            }
+            mtx->locked = 1;
+            pthread_mutex_unlock(&mtx->mtx);
+        }
+        return handle_recursion(mtx);
+    }
+    int res = pthread_mutex_trylock(&mtx->mtx);
+    if (res == 0)
+        return thrd_success;
+    return (res == EBUSY) ? thrd_busy : thrd_error;
+}
+
+int mtx_unlock(mtx_t* mtx)
+{
+    if (mtx->type & mtx_timed)
+    {
+        assert(mtx->count && pthread_equal(mtx->thrdid, pthread_self()));
+        if (mtx->count-- == 1)
+        {
+            mtx->thrdid = INVALID_THRDID;
+            pthread_mutex_lock(&mtx->mtx);
+            mtx->locked = 0;
+            pthread_cond_signal(&mtx->cond);
+            pthread_mutex_unlock(&mtx->mtx);
+        }
+        return thrd_success;
+    }
+    if (pthread_mutex_unlock(&mtx->mtx) == 0)
+        return thrd_success;
+    return thrd_error;
+}
+
+#endif /* defined(HAVE_TIMEDLOCK) */
+
+#elif defined(HAVE_WINDOWS_THREADS)
+
+#define INVALID_THRDID ((DWORD)-1)
+
+/*
+ *  7.26.3 Condition variable functions
+ */
+
+/*
+ *  A timed mutex is held through its locked flag, the waiter
+ *  takes the SRW lock before it clears the flag (see the pthread
+ *  version above).
+ */
+
+int cnd_clockwait(cnd_t* cond, mtx_t* mtx, int base
+    , const struct timespec* ts)
+{
+    mtx->thrdid = INVALID_THRDID;
+    mtx->count--;
+    if (mtx->type & mtx_timed)
+    {
+        AcquireSRWLockExclusive(&mtx->srwlock);
+        mtx->locked = 0;
+        WakeConditionVariable(&mtx->cv);
+    }
+    int ret = thrd_success;
+    if (!SleepConditionVariableSRW(cond, &mtx->srwlock
+        , deadline_to_msec(base, ts), 0))
+    {
+        if (GetLastError() == ERROR_TIMEOUT)
+            ret = thrd_timedout;
+        else
+            ret = thrd_error;
+    }
+    if (mtx->type & mtx_timed)
+    {
+        while (mtx->locked)
+            SleepConditionVariableSRW(&mtx->cv, &mtx->srwlock, INFINITE, 0);
+        mtx->locked = 1;
+        ReleaseSRWLockExclusive(&mtx->srwlock);
+    }
+    mtx->thrdid = GetCurrentThreadId();
+    mtx->count++;
+    return ret;
+}
+
+/*
+ *  7.26.4 Mutex functions
+ */
+
+void mtx_destroy(mtx_t* mtx)
+{
+    assert(mtx->count == 0);
+    (void)mtx;
+}
+
+int mtx_init(mtx_t* mtx, int type)
+{
+    memset(mtx, 0, sizeof(*mtx));
+    if (type & mtx_fair)
+        return thrd_error;
+    InitializeSRWLock(&mtx->srwlock);
+    InitializeConditionVariable(&mtx->cv);
+    mtx->thrdid = INVALID_THRDID;
+    mtx->type = type;
+    return thrd_success;
+}
+
+static inline int handle_recursion(mtx_t* mtx)
+{
+    if (mtx->count++ == 0)
+    {
+        mtx->thrdid = GetCurrentThreadId();
+    }
+    else if (!(mtx->type & mtx_recursive))
+    {
+        mtx->count--;
+        return thrd_error;
+    }
+    return thrd_success;
+}
+
+/*
+ *  Spin phase of mtx_adaptive mutexes, on success the mutex
+ *  has been acquired by mtx_trylock.
+ */
+
+static int mtx_spin(mtx_t* mtx)
+{
+    int spins = mtx->spins;
+    int limit = spin_limit(spins);
+    for (int i = 0; i < limit; i++)
+    {
+        if (mtx_trylock(mtx) == thrd_success)
+        {
+            mtx->spins = spin_update(spins, i, 1);
+            return 1;
+        }
+        thrd_cpu_relax();
+    }
+    mtx->spins = spin_update(spins, limit, 0);
+    return 0;
+}
+
+int mtx_lock(mtx_t* mtx)
+{
+    if ((mtx->type & mtx_adaptive) && mtx_spin(mtx))
+        return thrd_success;
+    if (mtx->thrdid != GetCurrentThreadId())
+    {
+        if (mtx->type & mtx_timed)
+        {
+            AcquireSRWLockExclusive(&mtx->srwlock);
+            while (mtx->locked)
+            {
+                if (!SleepConditionVariableSRW(&mtx->cv
+                    , &mtx->srwlock, INFINITE, 0))
+                {
+                    ReleaseSRWLockExclusive(&mtx->srwlock);
+                    return thrd_error;
+                }
+            }
+            mtx->locked = 1;
+            ReleaseSRWLockExclusive(&mtx->srwlock);
+        }
+        else
+        {
+            AcquireSRWLockExclusive(&mtx->srwlock);
+        }
+    }
+    return handle_recursion(mtx);
+}
+
+int mtx_clocklock(mtx_t* mtx, int base, const struct timespec* ts)
+{
+    if (!(mtx->type & mtx_timed))
+        return thrd_error;
+    if ((mtx->type & mtx_adaptive) && mtx_spin(mtx))
+        return thrd_success;
+    if (mtx->thrdid != GetCurrentThreadId())
+    {
+        AcquireSRWLockExclusive(&mtx->srwlock);
+        while (mtx->locked)
+        {
+            if (!SleepConditionVariableSRW(&mtx->cv
+                , &mtx->srwlock, deadline_to_msec(base, ts), 0))
+            {
+                ReleaseSRWLockExclusive(&mtx->srwlock);
+                if (GetLastError() == ERROR_TIMEOUT)
+                    return thrd_timedout;
+                else
+                    return thrd_error;
+            }
+        }
+        mtx->locked = 1;
+        ReleaseSRWLockExclusive(&mtx->srwlock);
+    }
+    return handle_recursion(mtx);
+}
+
+int mtx_timedlock(mtx_t* mtx, const struct timespec* ts)
+{
+    return mtx_clocklock(mtx, TIME_UTC, ts);
+}
+
+int mtx_trylock(mtx_t* mtx)
+{
+    if (mtx->thrdid != GetCurrentThreadId())
+    {
+        if (mtx->type & mtx_timed)
+        {
+            AcquireSRWLockExclusive(&mtx->srwlock);
+            if (mtx->locked)
+            {
+                ReleaseSRWLockExclusive(&mtx->srwlock);
+                return thrd_busy;
+            }
+            mtx->locked = 1;
+            ReleaseSRWLockExclusive(&mtx->srwlock);
+        }
+        else
+        {
+            if (!TryAcquireSRWLockExclusive(&mtx->srwlock))
+                return thrd_busy;
+        }
+    }
+    return handle_recursion(mtx);
+}
+
+int mtx_unlock(mtx_t* mtx)
+{
+    assert(mtx->count && mtx->thrdid == GetCurrentThreadId());
+    if (mtx->count-- == 1)
+    {
+        mtx->thrdid = INVALID_THRDID;
+        if (mtx->type & mtx_timed)
+        {
+            AcquireSRWLockExclusive(&mtx->srwlock);
+            mtx->locked = 0;
+            WakeConditionVariable(&mtx->cv);
+            ReleaseSRWLockExclusive(&mtx->srwlock);
+        }
+        else
+        {
+            ReleaseSRWLockExclusive(&mtx->srwlock);
+        }
+    }
+    return thrd_success;
+}
+
+/*
+ *  7.26.5 Thread functions
+ */
+
+struct thread
+{
+    _Alignas(CACHELINE_SIZE) HANDLE hnd;
+    DWORD id;
+    LONG state;
+};
+
+struct thread_param
+{
+    thrd_start_t proc;
+    void* data;
+    HANDLE entry_event;
+    struct thread* thrd;
+};
+
+enum
+{
+    st_running = 1,
+    st_finished,
+    st_joined,
+    st_detached
+};
+
+static once_flag g_once_flag = ONCE_FLAG_INIT;
+
+static DWORD g_thread_key = FLS_OUT_OF_INDEXES;
+
+static struct thread* g_main_thread = NULL;
+
+static void call_tss_destructors(void);
+
+static void __stdcall on_thread_exit(void*);
+
+static void on_process_exit(void);
+
+/*
+ *  The Old New Thing - Raymond Chen
+ *  A better way to clean up.
+ *  https://devblogs.microsoft.com/oldnewthing/20191011-00
+ */
+
+static void on_process_enter(void)
+{
+    g_thread_key = FlsAlloc(on_thread_exit);
+    if (g_thread_key == FLS_OUT_OF_INDEXES)
+        abort();
+    atexit(on_process_exit);
+}
+
+static inline void set_current_thread(struct thread* thrd)
+{
+    call_once(&g_once_flag, on_process_enter);
+    FlsSetValue(g_thread_key, thrd);
+}
+
+static inline struct thread* get_current_thread(void)
+{
+    call_once(&g_once_flag, on_process_enter);
+    return FlsGetValue(g_thread_key);
+}
+
+static unsigned __stdcall start_thread(void* arg)
+{
+    struct thread_param* param = arg;
+    thrd_start_t proc = param->proc;
+    void* data = param->data;
+    set_current_thread(param->thrd);
+    SetEvent(param->entry_event);
+    return proc(data);
+}
+
+/*
+ *  SetThreadDescription needs Windows 10, version 1607
+ */
+
+typedef HRESULT (__stdcall *set_description_t)(HANDLE, PCWSTR);
+
+static int apply_attributes(HANDLE hnd, const thrd_attr_t* attr)
+{
+    if (attr->affinity[0] && !SetThreadAffinityMask(hnd
+        , (DWORD_PTR)attr->affinity[0]))
+        return 0;
+    if (attr->priority && !SetThreadPriority(hnd, attr->priority))
+        return 0;
+    if (attr->name)
+    {
+        set_description_t set_description = (set_description_t)
+            GetProcAddress(GetModuleHandleW(L"kernel32.dll")
+                , "SetThreadDescription");
+        WCHAR name[64] = { 0 };
+        if (set_description && MultiByteToWideChar(CP_UTF8, 0, attr->name
+            , -1, name, sizeof(name) / sizeof(name[0]) - 1))
+            set_description(hnd, name);
+    }
+    return 1;
+}
+
+int thrd_create(thrd_t* thr, int (*func)(void*), void* arg)
+{
+    return thrd_create_ex(thr, func, arg, NULL);
+}
+
+int thrd_create_ex(thrd_t* thr, thrd_start_t func, void* arg
+    , const thrd_attr_t* attr)
+{
+    for (int i = 1; attr && i < THRD_CPU_WORDS; i++)
+    {
+        if (attr->affinity[i])
+            return thrd_error;
+    }
+    struct thread* thrd = _aligned_malloc(sizeof(*thrd), CACHELINE_SIZE);
+    if (thrd == NULL)
+        return thrd_nomem;
+    memset(thrd, 0, sizeof(*thrd));
+    int rollback = 1;
+    HANDLE entry_event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (entry_event == NULL)
+        goto failure;
+    rollback = 2;
+    struct thread_param param = { 0 };
+    param.proc = func;
+    param.data = arg;
+    param.entry_event = entry_event;
+    param.thrd = thrd;
+    unsigned int id = 0;
+    unsigned int stack_size = attr ? (unsigned int)attr->stack_size : 0;
+    uintptr_t hnd = _beginthreadex(NULL, stack_size, start_thread
+        , &param, CREATE_SUSPENDED | STACK_SIZE_PARAM_IS_A_RESERVATION
+        , &id);
+    if (hnd == 0)
+        goto failure;
+    rollback = 3;
+    thrd->hnd = (HANDLE)hnd;
+    thrd->id = id;
+    thrd->state = st_running;
+    if (attr && !apply_attributes(thrd->hnd, attr))
+    {
+        TerminateThread(thrd->hnd, 0);
+        goto failure;
+    }
+    if (ResumeThread(thrd->hnd) == (DWORD)-1)
+    {
+        TerminateThread(thrd->hnd, 0);
+        goto failure;
+    }
+    if (WaitForSingleObject(entry_event, INFINITE) == WAIT_FAILED)
+        goto failure;
+    CloseHandle(entry_event);
+    *thr = (thrd_t)thrd;
+    return thrd_success;
+failure:
+    switch (rollback)
+    {
+    case 3: CloseHandle(thrd->hnd);
+    case 2: CloseHandle(entry_event);
+    case 1: _aligned_free(thrd);
+    }
+    return thrd_error;
+}
+
+thrd_t thrd_current(void)
+{
+    struct thread* thrd = get_current_thread();
+    if (thrd == NULL)
+    {
+        if (g_main_thread)
+            abort();
+        thrd = _aligned_malloc(sizeof(*thrd), CACHELINE_SIZE);
+        if (thrd == NULL)
+            abort();
+        memset(thrd, 0, sizeof(*thrd));
+        if (!DuplicateHandle(GetCurrentProcess()
+            , GetCurrentThread(), GetCurrentProcess()
+            , &thrd->hnd, 0, FALSE, DUPLICATE_SAME_ACCESS))
+        {
+            _aligned_free(thrd);
+            abort();
+        }
+        thrd->id = GetThreadId(thrd->hnd);
+        thrd->state = st_detached;
+        g_main_thread = thrd;
+        set_current_thread(thrd);
+    }
+    return (thrd_t)thrd;
+}
+
+int thrd_detach(thrd_t thr)
+{
+    struct thread* thrd = (struct thread*)thr;
+    LONG state = InterlockedCompareExchange(&thrd->state
+        , st_detached, st_running);
+    assert(state == st_running || state == st_finished);
+    if (!CloseHandle(thrd->hnd))
+        return thrd_error;
+    if (state == st_finished)
+        _aligned_free(thrd);
+    return thrd_success;
+}
+
+int thrd_equal(thrd_t thr0, thrd_t thr1)
+{
+    struct thread* lhs = (struct thread*)thr0;
+    struct thread* rhs = (struct thread*)thr1;
+    return (lhs->id == rhs->id);
+}
+
+int thrd_join(thrd_t thr, int* res)
+{
+    struct thread* thrd = (struct thread*)thr;
+    if (GetCurrentThreadId() == thrd->id)
+        return thrd_error;
+    LONG state = InterlockedCompareExchange(&thrd->state
+        , st_joined, st_running);
+    if (state == st_detached)
+        return thrd_error;
+    assert(state == st_running || state == st_finished);
+    if (WaitForSingleObject(thrd->hnd, INFINITE) == WAIT_FAILED)
+        return thrd_error;
+    if (res)
+    {
+        if (!GetExitCodeThread(thrd->hnd, (LPDWORD)res))
+            return thrd_error;
+    }
+    if (!CloseHandle(thrd->hnd))
+        return thrd_error;
+    _aligned_free(thrd);
+    return thrd_success;
+}
+
+static void __stdcall on_thread_exit(void* arg)
+{
+    assert(arg);
+    struct thread* thrd = arg;
+    set_current_thread(NULL);
+    LONG state = InterlockedCompareExchange(&thrd->state
+        , st_finished, st_running);
+    assert(state != st_finished);
+    if (state == st_detached)
+        _aligned_free(thrd);
+}
+
+static void on_process_exit(void)
+{
+    if (g_main_thread)
+        call_tss_destructors();
+    FlsFree(g_thread_key);
+}
+
+#endif /* defined(HAVE_FUTEX) */
+
+#if defined(HAVE_EMULATED_TSS)
+
+/*
+ *  7.26.6 Thread-specific storage functions
+ *
+ *  Keys index the blocks of the threads, each thread only ever
+ *  touches its own block. Creating and deleting keys takes a
+ *  lock, reading the live keys and destructors doesn't, so a
+ *  destructor pass at thread exit reads them once per slot in
+ *  the dirty bitmap. Destructors may set values again (even grow
+ *  the block), which the next pass picks up, up to
+ *  TSS_DTOR_ITERATIONS passes.
+ */
+
+#if (TSS_KEYS_MAX > (1 << TSS_INDEX_BITS)) || (TSS_KEYS_MAX % 64)
+#   error TSS_KEYS_MAX must be a multiple of 64 up to 1 << TSS_INDEX_BITS
+#endif /* (TSS_KEYS_MAX > (1 << TSS_INDEX_BITS)) ... */
+
+#define TSS_INDEX_MASK (((size_t)1 << TSS_INDEX_BITS) - 1)
+
+static struct tss_block g_tss_empty;
+
+#if defined(C11_DLL)
+static _Thread_local struct tss_block* t_tss_block = &g_tss_empty;
+#else
+_Thread_local struct tss_block* t_tss_block = &g_tss_empty;
+#endif /* defined(C11_DLL) */
+
+/*
+ *  keys holds the live key of each index (0 if it is free),
+ *  generations how often the index has been handed out.
+ */
+
+static struct
+{
+    cmtx_t lock;
+    uint64_t used[TSS_KEYS_MAX / 64];
+    uintptr_t generations[TSS_KEYS_MAX];
+    atomic_intptr_t keys[TSS_KEYS_MAX];
+    atomic_uintptr_t dtors[TSS_KEYS_MAX];
+} g_tss = { CMTX_INITIALIZER, { 0 }, { 0 }, { 0 }, { 0 } };
+
+#if defined(HAVE_WINDOWS_THREADS)
+static DWORD g_tss_exit_key = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t g_tss_exit_key;
+#endif /* defined(HAVE_WINDOWS_THREADS) */
+
+static once_flag g_tss_once = ONCE_FLAG_INIT;
+
+static inline size_t lowest_bit(uint64_t bits)
+{
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward64(&index, bits);
+    return index;
+#else
+    return (size_t)__builtin_ctzll(bits);
+#endif /* defined(_MSC_VER) */
+}
+
+static void call_tss_destructors(void)
+{
+    for (int i = 0; i < TSS_DTOR_ITERATIONS; i++)
+    {
+        int called = 0;
+        for (size_t w = 0; w < t_tss_block->capacity / 64; w++)
+        {
+            uint64_t dirty = t_tss_block->dirty[w];
+            t_tss_block->dirty[w] = 0;
+            while (dirty)
+            {
+                size_t k = w * 64 + lowest_bit(dirty);
+                dirty &= dirty - 1;
+                struct tss_slot* slot = &t_tss_block->slots[k];
+                tss_t key = atomic_load_explicit(&g_tss.keys[k]
+                    , memory_order_acquire);
+                tss_dtor_t dtor = (tss_dtor_t)atomic_load_explicit(
+                    &g_tss.dtors[k], memory_order_acquire);
+                if (slot->value && slot->key == key && dtor)
+                {
+                    void* val = slot->value;
+                    slot->value = NULL;
+                    dtor(val);
+                    called = 1;
+                }
+            }
+        }
+        if (!called)
+            break;
+    }
+}
+
+#if defined(HAVE_WINDOWS_THREADS)
+static void __stdcall on_tss_exit(void* arg)
+#else
+static void on_tss_exit(void* arg)
+#endif /* defined(HAVE_WINDOWS_THREADS) */
+{
+    (void)arg;
+    call_tss_destructors();
+    struct tss_block* block = t_tss_block;
+    t_tss_block = &g_tss_empty;
+    free(block);
+}
+
+static void init_tss(void)
+{
+#if defined(HAVE_WINDOWS_THREADS)
+    g_tss_exit_key = FlsAlloc(on_tss_exit);
+    if (g_tss_exit_key == FLS_OUT_OF_INDEXES)
+        abort();
+#else
+    if (pthread_key_create(&g_tss_exit_key, on_tss_exit))
+        abort();
+#endif /* defined(HAVE_WINDOWS_THREADS) */
+}
+
+int tss_create(tss_t* key, tss_dtor_t dtor)
+{
+    cmtx_lock(&g_tss.lock);
+    for (size_t w = 0; w < TSS_KEYS_MAX / 64; w++)
+    {
+        if (~g_tss.used[w])
+        {
+            size_t k = w * 64 + lowest_bit(~g_tss.used[w]);
+            g_tss.used[w] |= (uint64_t)1 << (k % 64);
+            uintptr_t generation = (g_tss.generations[k] + 1)
+                & (UINTPTR_MAX >> (TSS_INDEX_BITS + 1));
+            if (generation == 0)
+                generation = 1;
+            g_tss.generations[k] = generation;
+            *key = (tss_t)((generation << TSS_INDEX_BITS) | k);
+            atomic_store_explicit(&g_tss.dtors[k], (uintptr_t)dtor
+                , memory_order_relaxed);
+            atomic_store_explicit(&g_tss.keys[k], *key
+                , memory_order_release);
+            cmtx_unlock(&g_tss.lock);
+            return thrd_success;
+        }
+    }
+    cmtx_unlock(&g_tss.lock);
+    return thrd_error;
+}
+
+/*
+ *  Values other threads still hold for the key stay in their
+ *  blocks, they no longer match a live key.
+ */
+
+void tss_delete(tss_t key)
+{
+    size_t k = (size_t)key & TSS_INDEX_MASK;
+    assert(k < TSS_KEYS_MAX);
+    cmtx_lock(&g_tss.lock);
+    assert(atomic_load_explicit(&g_tss.keys[k], memory_order_relaxed)
+        == key);
+    atomic_store_explicit(&g_tss.keys[k], 0, memory_order_relaxed);
+    atomic_store_explicit(&g_tss.dtors[k], 0, memory_order_relaxed);
+    g_tss.used[k / 64] &= ~((uint64_t)1 << (k % 64));
+    cmtx_unlock(&g_tss.lock);
+}
+
+int tss_set_slow(tss_t key, void* val)
+{
+    size_t k = (size_t)key & TSS_INDEX_MASK;
+    if (k >= TSS_KEYS_MAX)
+        return thrd_error;
+    struct tss_block* block = t_tss_block;
+    size_t capacity = (k + 64) & ~(size_t)63;
+    size_t nbtotal = offsetof(struct tss_block, slots)
+        + capacity * sizeof(struct tss_slot);
+    struct tss_block* grown = NULL;
+    if (block == &g_tss_empty)
+    {
+        call_once(&g_tss_once, init_tss);
+        grown = calloc(1, nbtotal);
+        if (grown == NULL)
+            return thrd_nomem;
+#if defined(HAVE_WINDOWS_THREADS)
+        FlsSetValue(g_tss_exit_key, grown);
+#else
+        pthread_setspecific(g_tss_exit_key, grown);
+#endif /* defined(HAVE_WINDOWS_THREADS) */
+    }
+    else
+    {
+        grown = realloc(block, nbtotal);
+        if (grown == NULL)
+            return thrd_nomem;
+        memset(&grown->slots[grown->capacity], 0
+            , (capacity - grown->capacity) * sizeof(struct tss_slot));
+    }
+    grown->capacity = capacity;
+    t_tss_block = grown;
+    return tss_block_set(grown, key, val);
+}
+
+#if defined(C11_DLL)
+
+void* tss_get(tss_t key)
+{
+    return tss_block_get(t_tss_block, key);
+}
+
+int tss_set(tss_t key, void* val)
+{
+    return tss_block_set(t_tss_block, key, val);
+}
+
+#endif /* defined(C11_DLL) */
+
+#endif /* defined(HAVE_EMULATED_TSS) */
+
+#if defined(HAVE_POSIX_THREADS)
+
+/*
+ *  Non-standard: thrd_create_ex
+ *
+ *  func returns an int, so it is called through start_thread
+ *  rather than cast to a pthread start routine. The name is set
+ *  by the new thread itself (that's the only way on Apple
+ *  platforms), before it calls func.
+ */
+
+struct thread_start
+{
+    thrd_start_t func;
+    void* arg;
+    char name[16];
+};
+
+static void* start_thread(void* arg)
+{
+    struct thread_start start = *(struct thread_start*)arg;
+    free(arg);
+    if (start.name[0])
+    {
+#if defined(__APPLE__)
+        pthread_setname_np(start.name);
+#else
+        pthread_setname_np(pthread_self(), start.name);
+#endif /* defined(__APPLE__) */
+    }
+    return (void*)(intptr_t)start.func(start.arg);
+}
+
+static int set_attributes(pthread_attr_t* pattr, const thrd_attr_t* attr)
+{
+    if (attr->stack_size)
+    {
+        size_t stack_size = (attr->stack_size < (size_t)PTHREAD_STACK_MIN)
+            ? (size_t)PTHREAD_STACK_MIN : attr->stack_size;
+        if (pthread_attr_setstacksize(pattr, stack_size))
+            return thrd_error;
+    }
+    if (attr->guard_size && pthread_attr_setguardsize(pattr
+        , attr->guard_size))
+        return thrd_error;
+    if (attr->policy != thrd_sched_other || attr->priority)
+    {
+        static const int policies[] = { SCHED_OTHER, SCHED_FIFO, SCHED_RR };
+        if (attr->policy < thrd_sched_other || attr->policy > thrd_sched_rr)
+            return thrd_error;
+        struct sched_param param = { 0 };
+        param.sched_priority = attr->priority;
+        if (pthread_attr_setinheritsched(pattr, PTHREAD_EXPLICIT_SCHED)
+            || pthread_attr_setschedpolicy(pattr, policies[attr->policy])
+            || pthread_attr_setschedparam(pattr, &param))
+            return thrd_error;
+    }
+#if defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    int pinned = 0;
+    for (unsigned int i = 0; i < THRD_CPU_WORDS * 64 && i < CPU_SETSIZE; i++)
+    {
+        if (attr->affinity[i / 64] & ((uint64_t)1 << (i % 64)))
+        {
+            CPU_SET(i, &cpus);
+            pinned = 1;
+        }
+    }
+    if (pinned && pthread_attr_setaffinity_np(pattr, sizeof(cpus), &cpus))
+        return thrd_error;
+#else
+    for (int i = 0; i < THRD_CPU_WORDS; i++)
+    {
+        if (attr->affinity[i])
+            return thrd_error;
+    }
+#endif /* defined(__linux__) */
+    return thrd_success;
+}
+
+int thrd_create_ex(thrd_t* thr, thrd_start_t func, void* arg
+    , const thrd_attr_t* attr)
+{
+    static const thrd_attr_t defaults = { 0 };
+    if (attr == NULL)
+        attr = &defaults;
+    pthread_attr_t pattr;
+    if (pthread_attr_init(&pattr))
+        return thrd_error;
+    int res = set_attributes(&pattr, attr);
+    if (res != thrd_success)
+    {
+        pthread_attr_destroy(&pattr);
+        return res;
+    }
+    struct thread_start* start = calloc(1, sizeof(*start));
+    if (start == NULL)
+    {
+        pthread_attr_destroy(&pattr);
+        return thrd_nomem;
+    }
+    start->func = func;
+    start->arg = arg;
+    if (attr->name)
+        strncpy(start->name, attr->name, sizeof(start->name) - 1);
+    res = pthread_create(thr, &pattr, start_thread, start);
+    if (res)
+        free(start);
+    pthread_attr_destroy(&pattr);
+    if (res == 0)
+        return thrd_success;
+    return (res == ENOMEM) ? thrd_nomem : thrd_error;
+}
+
+int thrd_create(thrd_t* thr, thrd_start_t func, void* arg)
+{
+    return thrd_create_ex(thr, func, arg, NULL);
+}
+
+#endif /* defined(HAVE_POSIX_THREADS) */
+
+/*
+ *  Precise sleep (non-standard)
+ *
+ *  The spin margin is the average delay of recent wakeups plus
+ *  twice their average deviation. Calls that are too short to
+ *  sleep let both decay, otherwise a burst of late wakeups
+ *  would keep the thread spinning for good.
+ */
+
+#if defined(__linux__)
+#   include <sys/prctl.h>
+#endif /* defined(__linux__) */
+
+#if defined(HAVE_WINDOWS_THREADS)
+
+#if !defined(CREATE_WAITABLE_TIMER_HIGH_RESOLUTION)
+#   define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif /* !defined(CREATE_WAITABLE_TIMER_HIGH_RESOLUTION) */
+
+/*
+ *  Every thread creates its waitable timer once and keeps it in
+ *  a fiber local slot, whose callback closes it on thread exit.
+ */
+
+static once_flag g_sleep_timer_once = ONCE_FLAG_INIT;
+static DWORD g_sleep_timer_key = FLS_OUT_OF_INDEXES;
+
+static void __stdcall close_sleep_timer(void* timer)
+{
+    if (timer)
+        CloseHandle(timer);
+}
+
+static void init_sleep_timer(void)
+{
+    g_sleep_timer_key = FlsAlloc(close_sleep_timer);
+}
+
+static HANDLE get_sleep_timer(void)
+{
+    call_once(&g_sleep_timer_once, init_sleep_timer);
+    if (g_sleep_timer_key == FLS_OUT_OF_INDEXES)
+        return NULL;
+    HANDLE timer = FlsGetValue(g_sleep_timer_key);
+    if (timer == NULL)
+    {
+        timer = CreateWaitableTimerExW(NULL, NULL
+            , CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (timer && !FlsSetValue(g_sleep_timer_key, timer))
+        {
+            CloseHandle(timer);
+            timer = NULL;
+        }
+    }
+    return timer;
+}
+
+#endif /* defined(HAVE_WINDOWS_THREADS) */
+
+static _Thread_local long long t_sleep_late = THRD_SLEEP_SPIN_NSEC / 2;
+static _Thread_local long long t_sleep_jitter = THRD_SLEEP_SPIN_NSEC / 4;
+
+static inline long long sleep_margin(void)
+{
+    long long margin = t_sleep_late + 2 * t_sleep_jitter;
+    return (margin < THRD_SLEEP_SPIN_LIMIT) ? margin : THRD_SLEEP_SPIN_LIMIT;
+}
+
+static inline long long timespec_to_nsec(const struct timespec* ts)
+{
+    return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static inline long long monotonic_nsec(void)
+{
+    struct timespec now = { 0 };
+    timespec_get(&now, TIME_MONOTONIC);
+    return timespec_to_nsec(&now);
+}
+
+static void sleep_until_nsec(long long deadline)
+{
+#if defined(HAVE_WINDOWS_THREADS)
+    long long nsec = deadline - monotonic_nsec();
+    if (nsec <= 0)
+        return;
+    HANDLE timer = get_sleep_timer();
+    if (timer == NULL)
+    {
+        Sleep((DWORD)(nsec / 1000000LL));
+        return;
+    }
+    LARGE_INTEGER due = { 0 };
+    due.QuadPart = -(nsec / 100);
+    if (SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE))
+        WaitForSingleObject(timer, INFINITE);
+#elif defined(__APPLE__)
+    long long nsec = deadline - monotonic_nsec();
+    if (nsec <= 0)
+        return;
+    struct timespec ts = { (time_t)(nsec / 1000000000LL)
+        , (long)(nsec % 1000000000LL) };
+    nanosleep(&ts, NULL);
+#else
+    struct timespec ts = { (time_t)(deadline / 1000000000LL)
+        , (long)(deadline % 1000000000LL) };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+#endif /* defined(HAVE_WINDOWS_THREADS) */
+}
+
+int thrd_sleep_until(int base, const struct timespec* deadline)
+{
+    long long now = monotonic_nsec();
+    long long target = timespec_to_nsec(deadline);
+    if (base != TIME_MONOTONIC)
+    {
+        struct timespec ts = { 0 };
+        if (timespec_get(&ts, base) != base)
+            return thrd_error;
+        target = now + (target - timespec_to_nsec(&ts));
+    }
+    if (target - now <= sleep_margin())
+    {
+        t_sleep_late -= t_sleep_late / 8;
+        t_sleep_jitter -= t_sleep_jitter / 8;
+    }
+    while (target - now > sleep_margin())
+    {
+        long long wake = target - sleep_margin();
+        sleep_until_nsec(wake);
+        now = monotonic_nsec();
+        long long diff = (now - wake) - t_sleep_late;
+        t_sleep_late += diff / 8;
+        t_sleep_jitter += ((diff < 0 ? -diff : diff) - t_sleep_jitter) / 8;
+    }
+    while (now < target)
+    {
+        thrd_cpu_relax();
+        now = monotonic_nsec();
+    }
+    return thrd_success;
+}
+
+int thrd_sleep_precise(const struct timespec* duration)
+{
+    struct timespec deadline = { 0 };
+    return thrd_sleep_until(TIME_MONOTONIC
+        , thrd_deadline(&deadline, TIME_MONOTONIC, duration));
+}
+
+int thrd_timer_slack(unsigned long nsec)
+{
+#if defined(__linux__)
+    if (prctl(PR_SET_TIMERSLACK, nsec, 0, 0, 0) == 0)
+        return thrd_success;
+#else
+    (void)nsec;
+#endif /* defined(__linux__) */
+    return thrd_error;
+}
+
+/*
+ *  Reader-writer lock functions (non-standard)
+ */
+
+#define RWL_PENDING 1U  /* a writer owns wmtx, readers stay out */
+#define RWL_HELD 2U     /* the writer has drained all readers */
+#define RWL_SLEEPERS 4U /* readers are parked on state */
+#define RWL_READER 8U   /* one reader (rwl_plain only) */
+
+#define RWL_MAX_STRIPES 64
+
+/*
+ *  Online processors: the ones threads can actually run on,
+ *  which is what stripes and workers are sized for.
+ */
+
+unsigned int thrd_processor_count(void)
+{
+#if defined(HAVE_POSIX_THREADS)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (unsigned int)count : 1;
+#elif defined(HAVE_WINDOWS_THREADS)
+    SYSTEM_INFO si = { 0 };
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors;
+#endif /* defined(HAVE_POSIX_THREADS) */
+}
 
 /*
- *  7.26.4 Mutex functions
+ *  Readers may migrate between entering and leaving, so
+ *  individual stripes can wrap around, only their sum counts.
  */
 
-void mtx_destroy(mtx_t* mtx)
+static inline atomic_uint* current_stripe(rwl_t* rwl)
 {
-    assert(mtx->count == 0);
-    pthread_mutex_destroy(&mtx->mtx);
-    if (mtx->type & mtx_timed)
-        pthread_cond_destroy(&mtx->cond);
+#if defined(__linux__)
+    int cpu = sched_getcpu();
+    unsigned int index = (cpu > 0) ? (unsigned int)cpu : 0;
+#elif defined(HAVE_WINDOWS_THREADS)
+    unsigned int index = GetCurrentProcessorNumber();
+#else
+    static _Thread_local char anchor;
+    unsigned int index = (unsigned int)((uintptr_t)&anchor >> 12);
+#endif /* defined(__linux__) */
+    return &rwl->stripes[index & rwl->mask].readers;
 }
 
-int mtx_init(mtx_t* mtx, int type)
+static unsigned int count_readers(rwl_t* rwl)
 {
-    memset(mtx, 0, sizeof(*mtx));
-    int res = 0;
-    if (mtx->type & mtx_timed)
-    {
-        res = pthread_cond_init(&mtx->cond, NULL);
-        if (res)
-            return (res == ENOMEM) ? thrd_nomem : thrd_error;
-#if defined(__APPLE__)
-        pthread_mutexattr_t attr;
-        pthread_mutexattr_init(&attr);
-        pthread_mutexattr_setpolicy_np(&attr
-            , _PTHREAD_MUTEX_POLICY_FIRSTFIT);
-        res = pthread_mutex_init(&mtx->mtx, &attr);
-        pthread_mutexattr_destroy(&attr);
-#else
-        res = pthread_mutex_init(&mtx->mtx, NULL);
-#endif /* defined(__APPLE__) */
-        if (res)
-            pthread_cond_destroy(&mtx->cond);
-        mtx->thrdid = INVALID_THRDID;
-        mtx->type = type;
-    }
-    else if (type & mtx_recursive)
+    if (!(rwl->type & rwl_scalable))
     {
-        pthread_mutexattr_t attr = { 0 };
-        pthread_mutexattr_init(&attr);
-#if defined(__APPLE__)
-        pthread_mutexattr_setpolicy_np(&attr
-            , _PTHREAD_MUTEX_POLICY_FIRSTFIT);
-#endif /* defined(__APPLE__) */
-        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
-        res = pthread_mutex_init(&mtx->mtx, &attr);
-        pthread_mutexattr_destroy(&attr);
+        return atomic_load_explicit(&rwl->state
+            , memory_order_acquire) / RWL_READER;
     }
-    else
+    unsigned int count = 0;
+    for (unsigned int i = 0; i <= rwl->mask; i++)
     {
-        res = pthread_mutex_init(&mtx->mtx, NULL);
+        count += atomic_load_explicit(&rwl->stripes[i].readers
+            , memory_order_seq_cst);
     }
-    if (res == 0)
-        return thrd_success;
-    return (res == ENOMEM) ? thrd_nomem : thrd_error;
+    return count;
 }
 
-static inline int handle_recursion(mtx_t* mtx)
+static void notify_writer(rwl_t* rwl)
 {
-    if (mtx->count++ == 0)
+    atomic_fetch_add_explicit(&rwl->drain, 1, memory_order_seq_cst);
+    futex_wake(&rwl->drain, 1);
+}
+
+static int enter_reader(rwl_t* rwl)
+{
+    if (rwl->type & rwl_scalable)
     {
-        mtx->thrdid = pthread_self();
+        atomic_uint* readers = current_stripe(rwl);
+        atomic_fetch_add_explicit(readers, 1, memory_order_seq_cst);
+        if (!(atomic_load_explicit(&rwl->state
+            , memory_order_seq_cst) & RWL_PENDING))
+            return 1;
+        atomic_fetch_sub_explicit(readers, 1, memory_order_seq_cst);
+        notify_writer(rwl);
+        return 0;
     }
-    else if (!(mtx->type & mtx_recursive))
+    unsigned int state = atomic_load_explicit(&rwl->state
+        , memory_order_relaxed);
+    while (!(state & RWL_PENDING))
     {
-        mtx->count--;
-        return thrd_error;
+        if (atomic_compare_exchange_weak_explicit(&rwl->state, &state
+            , state + RWL_READER, memory_order_acquire
+            , memory_order_relaxed))
+            return 1;
     }
-    return thrd_success;
+    return 0;
 }
 
-int mtx_lock(mtx_t* mtx)
+static void leave_reader(rwl_t* rwl)
 {
-    if (mtx->type & mtx_timed)
+    if (rwl->type & rwl_scalable)
     {
-        if (!pthread_equal(mtx->thrdid, pthread_self()))
-        {
-            pthread_mutex_lock(&mtx->mtx);
-            while (mtx->locked)
-                pthread_cond_wait(&mtx->cond, &mtx->mtx);
-            mtx->locked = 1;
-            pthread_mutex_unlock(&mtx->mtx);
-        }
-        return handle_recursion(mtx);
+        atomic_fetch_sub_explicit(current_stripe(rwl), 1
+            , memory_order_seq_cst);
+        if (atomic_load_explicit(&rwl->state
+            , memory_order_seq_cst) & RWL_PENDING)
+            notify_writer(rwl);
+        return;
     }
-    if (pthread_mutex_lock(&mtx->mtx) == 0)
-        return thrd_success;
-    return thrd_error;
+    unsigned int state = atomic_fetch_sub_explicit(&rwl->state
+        , RWL_READER, memory_order_release) - RWL_READER;
+    if ((state & RWL_PENDING) && state < RWL_READER)
+        notify_writer(rwl);
 }
 
-int mtx_timedlock(mtx_t* mtx, const struct timespec* ts)
+static int lock_reader(rwl_t* rwl, const struct timespec* ts)
 {
-    if (!(mtx->type & mtx_timed))
-        return thrd_error;
-    if (!pthread_equal(mtx->thrdid, pthread_self()))
+    while (!enter_reader(rwl))
     {
-        pthread_mutex_lock(&mtx->mtx);
-        while (mtx->locked)
-        {
-            int res = pthread_cond_timedwait(&mtx->cond, &mtx->mtx, ts);
-            if (res)
-            {
-                pthread_mutex_unlock(&mtx->mtx);
-                return (res == ETIMEDOUT) ? thrd_busy : thrd_error;
-            }
-        }
-        mtx->locked = 1;
-        pthread_mutex_unlock(&mtx->mtx);
+        unsigned int state = atomic_load_explicit(&rwl->state
+            , memory_order_relaxed);
+        if (!(state & RWL_PENDING))
+            continue;
+        if (!(state & RWL_SLEEPERS)
+            && !atomic_compare_exchange_weak_explicit(&rwl->state
+                , &state, state | RWL_SLEEPERS, memory_order_relaxed
+                , memory_order_relaxed))
+            continue;
+        int res = futex_wait(&rwl->state, state | RWL_SLEEPERS, ts);
+        if (res == ETIMEDOUT)
+            return thrd_timedout;
+        if (res == EINVAL)
+            return thrd_error;
     }
-    return handle_recursion(mtx);
+    return thrd_success;
 }
 
-int mtx_trylock(mtx_t* mtx)
+static void unlock_writer(rwl_t* rwl)
 {
-    if (mtx->type & mtx_timed)
+    unsigned int state = atomic_fetch_and_explicit(&rwl->state
+        , ~(RWL_PENDING | RWL_HELD | RWL_SLEEPERS)
+        , memory_order_release);
+    if (state & RWL_SLEEPERS)
+        futex_wake(&rwl->state, INT_MAX);
+    mtx_unlock(&rwl->wmtx);
+}
+
+static int lock_writer(rwl_t* rwl, const struct timespec* ts)
+{
+    int res = ts ? mtx_timedlock(&rwl->wmtx, ts) : mtx_lock(&rwl->wmtx);
+    if (res != thrd_success)
+        return (res == thrd_busy) ? thrd_timedout : res;
+    atomic_fetch_or_explicit(&rwl->state, RWL_PENDING
+        , memory_order_seq_cst);
+    for (;;)
     {
-        if (!pthread_equal(mtx->thrdid, pthread_self()))
+        unsigned int drain = atomic_load_explicit(&rwl->drain
+            , memory_order_seq_cst);
+        if (count_readers(rwl) == 0)
+            break;
+        res = futex_wait(&rwl->drain, drain, ts);
+        if (res == ETIMEDOUT || res == EINVAL)
         {
-            pthread_mutex_lock(&mtx->mtx);
-            if (mtx->locked)
-            {
-                pthread_mutex_unlock(&mtx->mtx);
-                return thrd_busy;
-            }
-            mtx->locked = 1;
-            pthread_mutex_unlock(&mtx->mtx);
+            unlock_writer(rwl);
+            return (res == ETIMEDOUT) ? thrd_timedout : thrd_error;
         }
-        return handle_recursion(mtx);
     }
-    int res = pthread_mutex_trylock(&mtx->mtx);
-    if (res == 0)
-        return thrd_success;
-    return (res == EBUSY) ? thrd_busy : thrd_error;
+    atomic_fetch_or_explicit(&rwl->state, RWL_HELD, memory_order_relaxed);
+    return thrd_success;
 }
 
-int mtx_unlock(mtx_t* mtx)
+void rwl_destroy(rwl_t* rwl)
 {
-    if (mtx->type & mtx_timed)
+    assert(atomic_load(&rwl->state) == 0);
+    mtx_destroy(&rwl->wmtx);
+    if (rwl->stripes)
+        aligned_free(rwl->stripes);
+}
+
+int rwl_init(rwl_t* rwl, int type)
+{
+    memset(rwl, 0, sizeof(*rwl));
+    rwl->type = type;
+    if (type & rwl_scalable)
     {
-        assert(mtx->count && pthread_equal(mtx->thrdid, pthread_self()));
-        if (mtx->count-- == 1)
-        {
-            mtx->thrdid = INVALID_THRDID;
-            pthread_mutex_lock(&mtx->mtx);
-            mtx->locked = 0;
-            pthread_cond_signal(&mtx->cond);
-            pthread_mutex_unlock(&mtx->mtx);
-        }
-        return thrd_success;
+        unsigned int count = 1;
+        unsigned int limit = thrd_processor_count();
+        while (count < limit && count < RWL_MAX_STRIPES)
+            count <<= 1;
+        size_t nbtotal = count * sizeof(struct rwl_stripe);
+        rwl->stripes = aligned_alloc(CACHELINE_SIZE, nbtotal);
+        if (rwl->stripes == NULL)
+            return thrd_nomem;
+        memset(rwl->stripes, 0, nbtotal);
+        rwl->mask = count - 1;
     }
-    if (pthread_mutex_unlock(&mtx->mtx) == 0)
-        return thrd_success;
-    return thrd_error;
+    int res = mtx_init(&rwl->wmtx, mtx_timed);
+    if (res != thrd_success && rwl->stripes)
+        aligned_free(rwl->stripes);
+    return res;
 }
 
-#elif defined(HAVE_WINDOWS_THREADS)
+int rwl_rdlock(rwl_t* rwl)
+{
+    return lock_reader(rwl, NULL);
+}
 
-#include <stdlib.h>
+int rwl_timedrdlock(rwl_t* rwl, const struct timespec* ts)
+{
+    return lock_reader(rwl, ts);
+}
 
-#define INVALID_THRDID ((DWORD)-1)
+int rwl_tryrdlock(rwl_t* rwl)
+{
+    if (enter_reader(rwl))
+        return thrd_success;
+    return thrd_busy;
+}
 
-/*
- *  7.26.3 Condition variable functions
- */
+int rwl_wrlock(rwl_t* rwl)
+{
+    return lock_writer(rwl, NULL);
+}
 
-int cnd_timedwait(cnd_t* cond, mtx_t* mtx, const struct timespec* ts)
+int rwl_timedwrlock(rwl_t* rwl, const struct timespec* ts)
 {
-    mtx->thrdid = INVALID_THRDID;
-    mtx->count--;
-    DWORD msec = INFINITE;
-    if (ts)
-    {
-        struct timespec now = { 0 };
-        timespec_get(&now, TIME_UTC);
-        __int64 diff = (ts->tv_sec * 1000000000L + ts->tv_nsec)
-            - (now.tv_sec * 1000000000L + now.tv_nsec);
-        diff = (diff > 0) ? diff : 0;
-        msec = (DWORD)(diff / 1000000LL);
-    }
-    int ret = thrd_success;
-    if (!SleepConditionVariableSRW(cond, &mtx->srwlock, msec, 0))
+    return lock_writer(rwl, ts);
+}
+
+int rwl_trywrlock(rwl_t* rwl)
+{
+    if (mtx_trylock(&rwl->wmtx) != thrd_success)
+        return thrd_busy;
+    atomic_fetch_or_explicit(&rwl->state, RWL_PENDING
+        , memory_order_seq_cst);
+    if (count_readers(rwl) != 0)
     {
-        if (GetLastError() == ERROR_TIMEOUT)
-            ret = thrd_timedout;
-        else
-            ret = thrd_error;
+        unlock_writer(rwl);
+        return thrd_busy;
     }
-    mtx->thrdid = GetCurrentThreadId();
-    mtx->count++;
-    return ret;
+    atomic_fetch_or_explicit(&rwl->state, RWL_HELD, memory_order_relaxed);
+    return thrd_success;
+}
+
+int rwl_unlock(rwl_t* rwl)
+{
+    if (atomic_load_explicit(&rwl->state, memory_order_relaxed) & RWL_HELD)
+        unlock_writer(rwl);
+    else
+        leave_reader(rwl);
+    return thrd_success;
 }
 
 /*
- *  7.26.4 Mutex functions
+ *  Futures: set claims the future (FUTURE_SET) before it stores
+ *  the value and publishes it (FUTURE_READY). Continuations are
+ *  pushed onto a stack, which set replaces with a sentinel before
+ *  publishing: a getter may destroy the future as soon as it sees
+ *  FUTURE_READY, so after that set only uses the address to wake
+ *  waiters and the detached stack to run the continuations.
  */
 
-void mtx_destroy(mtx_t* mtx)
+#define FUTURE_WAITERS 1
+#define FUTURE_SET 2
+#define FUTURE_READY 4
+
+struct future_callback
 {
-    assert(mtx->count == 0);
-    (void)mtx;
+    struct future_callback* next;
+    future_callback_t func;
+    void* arg;
+};
+
+static struct future_callback g_future_done;
+
+void future_destroy(future_t* future)
+{
+    struct future_callback* callback = atomic_load_explicit(
+        &future->callbacks, memory_order_acquire);
+    while (callback && callback != &g_future_done)
+    {
+        struct future_callback* next = callback->next;
+        free(callback);
+        callback = next;
+    }
 }
 
-int mtx_init(mtx_t* mtx, int type)
+int future_init(future_t* future)
 {
-    memset(mtx, 0, sizeof(*mtx));
-    InitializeSRWLock(&mtx->srwlock);
-    InitializeConditionVariable(&mtx->cv);
-    mtx->thrdid = INVALID_THRDID;
-    mtx->type = type;
+    atomic_init(&future->state, 0);
+    future->value = NULL;
+    atomic_init(&future->callbacks, NULL);
     return thrd_success;
 }
 
-static inline int handle_recursion(mtx_t* mtx)
+int future_set(future_t* future, void* value)
 {
-    if (mtx->count++ == 0)
+    if (atomic_fetch_or_explicit(&future->state, FUTURE_SET
+        , memory_order_relaxed) & FUTURE_SET)
+        return thrd_error;
+    future->value = value;
+    struct future_callback* callback = atomic_exchange_explicit(
+        &future->callbacks, &g_future_done, memory_order_acq_rel);
+    if (atomic_fetch_or_explicit(&future->state, FUTURE_READY
+        , memory_order_release) & FUTURE_WAITERS)
+        futex_wake(&future->state, INT_MAX);
+    struct future_callback* ordered = NULL;
+    while (callback)
     {
-        mtx->thrdid = GetCurrentThreadId();
+        struct future_callback* next = callback->next;
+        callback->next = ordered;
+        ordered = callback;
+        callback = next;
     }
-    else if (!(mtx->type & mtx_recursive))
+    while (ordered)
     {
-        mtx->count--;
-        return thrd_error;
+        struct future_callback* next = ordered->next;
+        ordered->func(value, ordered->arg);
+        free(ordered);
+        ordered = next;
     }
     return thrd_success;
 }
 
-int mtx_lock(mtx_t* mtx)
+int future_get(future_t* future, void** value)
 {
-    if (mtx->thrdid != GetCurrentThreadId())
-    {
-        if (mtx->type & mtx_timed)
-        {
-            AcquireSRWLockExclusive(&mtx->srwlock);
-            while (mtx->locked)
-            {
-                if (!SleepConditionVariableSRW(&mtx->cv
-                    , &mtx->srwlock, INFINITE, 0))
-                {
-                    ReleaseSRWLockExclusive(&mtx->srwlock);
-                    return thrd_error;
-                }
-            }
-            mtx->locked = 1;
-            ReleaseSRWLockExclusive(&mtx->srwlock);
-        }
-        else
-        {
-            AcquireSRWLockExclusive(&mtx->srwlock);
-        }
-    }
-    return handle_recursion(mtx);
+    return future_timedget(future, value, NULL);
 }
 
-int mtx_timedlock(mtx_t* mtx, const struct timespec* ts)
+int future_timedget(future_t* future, void** value
+    , const struct timespec* ts)
 {
-    if (!(mtx->type & mtx_timed))
-        return thrd_error;
-    if (mtx->thrdid != GetCurrentThreadId())
+    unsigned int state = 0;
+    for (int i = 0; i < MTX_SPIN_LIMIT; i++)
     {
-        struct timespec now = { 0 };
-        __int64 diff = (ts->tv_sec * 1000000000L + ts->tv_nsec)
-            - (now.tv_sec * 1000000000L + now.tv_nsec);
-        diff = (diff > 0) ? diff : 0;
-        DWORD msec = (DWORD)(diff / 1000000LL);
-        AcquireSRWLockExclusive(&mtx->srwlock);
-        while (mtx->locked)
-        {
-            if (!SleepConditionVariableSRW(&mtx->cv
-                , &mtx->srwlock, msec, 0))
-            {
-                ReleaseSRWLockExclusive(&mtx->srwlock);
-                if (GetLastError() == ERROR_TIMEOUT)
-                    return thrd_timedout;
-                else
-                    return thrd_error;
-            }
-        }
-        mtx->locked = 1;
-        ReleaseSRWLockExclusive(&mtx->srwlock);
+        state = atomic_load_explicit(&future->state, memory_order_acquire);
+        if (state & FUTURE_READY)
+            break;
+        thrd_cpu_relax();
     }
-    return handle_recursion(mtx);
+    while (!(state & FUTURE_READY))
+    {
+        if (!(state & FUTURE_WAITERS)
+            && !atomic_compare_exchange_weak_explicit(&future->state
+                , &state, state | FUTURE_WAITERS, memory_order_acquire
+                , memory_order_acquire))
+            continue;
+        int res = futex_wait(&future->state, state | FUTURE_WAITERS, ts);
+        if (res == ETIMEDOUT)
+            return thrd_timedout;
+        if (res == EINVAL)
+            return thrd_error;
+        state = atomic_load_explicit(&future->state, memory_order_acquire);
+    }
+    if (value)
+        *value = future->value;
+    return thrd_success;
 }
 
-int mtx_trylock(mtx_t* mtx)
+int future_ready(future_t* future)
 {
-    if (mtx->thrdid != GetCurrentThreadId())
+    return (atomic_load_explicit(&future->state
+        , memory_order_acquire) & FUTURE_READY) != 0;
+}
+
+int future_then(future_t* future, future_callback_t func, void* arg)
+{
+    struct future_callback* head = atomic_load_explicit(
+        &future->callbacks, memory_order_acquire);
+    if (head != &g_future_done)
     {
-        if (mtx->type & mtx_timed)
-        {
-            AcquireSRWLockExclusive(&mtx->srwlock);
-            if (mtx->locked)
-            {
-                ReleaseSRWLockExclusive(&mtx->srwlock);
-                return thrd_busy;
-            }
-            mtx->locked = 1;
-            ReleaseSRWLockExclusive(&mtx->srwlock);
-        }
-        else
+        struct future_callback* callback = malloc(sizeof(*callback));
+        if (callback == NULL)
+            return thrd_nomem;
+        callback->func = func;
+        callback->arg = arg;
+        do
         {
-            if (!TryAcquireSRWLockExclusive(&mtx->srwlock))
-                return thrd_busy;
+            callback->next = head;
+            if (atomic_compare_exchange_weak_explicit(&future->callbacks
+                , &head, callback, memory_order_release
+                , memory_order_acquire))
+                return thrd_success;
         }
+        while (head != &g_future_done);
+        free(callback);
     }
-    return handle_recursion(mtx);
+    func(future->value, arg);
+    return thrd_success;
 }
 
-int mtx_unlock(mtx_t* mtx)
+/*
+ *  Semaphore functions
+ *
+ *  Waiters announce themselves before checking the count for the
+ *  last time and posters check for waiters after adding to it
+ *  (all sequentially consistent), so one of them always sees the
+ *  other. futex_wait doesn't block unless the count is still 0.
+ */
+
+int sema_wait_slow(sema_t* sem, const struct timespec* ts)
 {
-    assert(mtx->count && mtx->thrdid == GetCurrentThreadId());
-    if (mtx->count-- == 1)
+    int res = thrd_success;
+    atomic_fetch_add_explicit(&sem->waiters, 1, memory_order_seq_cst);
+    for (;;)
     {
-        mtx->thrdid = INVALID_THRDID;
-        if (mtx->type & mtx_timed)
+        unsigned int count = atomic_load_explicit(&sem->count
+            , memory_order_seq_cst);
+        if (count)
         {
-            AcquireSRWLockExclusive(&mtx->srwlock);
-            mtx->locked = 0;
-            WakeConditionVariable(&mtx->cv);
-            ReleaseSRWLockExclusive(&mtx->srwlock);
+            if (atomic_compare_exchange_weak_explicit(&sem->count, &count
+                , count - 1, memory_order_acquire, memory_order_relaxed))
+                break;
+            continue;
         }
-        else
+        int err = futex_wait(&sem->count, 0, ts);
+        if (err == ETIMEDOUT)
         {
-            ReleaseSRWLockExclusive(&mtx->srwlock);
+            res = sema_trywait(sem);
+            res = (res == thrd_success) ? res : thrd_timedout;
+            break;
+        }
+        if (err == EINVAL)
+        {
+            res = thrd_error;
+            break;
         }
     }
-    return thrd_success;
+    atomic_fetch_sub_explicit(&sem->waiters, 1, memory_order_relaxed);
+    return res;
+}
+
+void sema_wake(sema_t* sem, unsigned int count)
+{
+    futex_wake(&sem->count, (count < INT_MAX) ? (int)count : INT_MAX);
 }
 
 /*
- *  7.26.5 Thread functions
+ *  Latch functions
+ *
+ *  Every arrival changes state, which only makes futex_wait
+ *  return early, the wakeup comes with the arrival that brings
+ *  the count to zero. futex_wake merely uses the address, so
+ *  it doesn't mind if the latch is gone by then.
  */
 
-struct thread
-{
-    _Alignas(CACHELINE_SIZE) HANDLE hnd;
-    struct
-    {
-        void** values;
-        SIZE_T capacity;
-    } tss;
-    DWORD id;
-    LONG state;
-};
+#define LATCH_WAITERS 1
 
-struct thread_param
+int latch_timedwait(latch_t* latch, const struct timespec* ts)
 {
-    thrd_start_t proc;
-    void* data;
-    HANDLE entry_event;
-    struct thread* thrd;
-};
+    unsigned int state = 0;
+    for (int i = 0; i < MTX_SPIN_LIMIT; i++)
+    {
+        state = atomic_load_explicit(&latch->state, memory_order_acquire);
+        if (state < 2)
+            return thrd_success;
+        thrd_cpu_relax();
+    }
+    while (state >= 2)
+    {
+        if (!(state & LATCH_WAITERS)
+            && !atomic_compare_exchange_weak_explicit(&latch->state
+                , &state, state | LATCH_WAITERS, memory_order_acquire
+                , memory_order_acquire))
+            continue;
+        int res = futex_wait(&latch->state, state | LATCH_WAITERS, ts);
+        if (res == ETIMEDOUT)
+            return latch_trywait(latch) == thrd_success
+                ? thrd_success : thrd_timedout;
+        if (res == EINVAL)
+            return thrd_error;
+        state = atomic_load_explicit(&latch->state, memory_order_acquire);
+    }
+    return thrd_success;
+}
 
-enum
+void latch_wake(latch_t* latch)
 {
-    st_running = 1,
-    st_finished,
-    st_joined,
-    st_detached
-};
-
-static once_flag g_once_flag = ONCE_FLAG_INIT;
+    futex_wake(&latch->state, INT_MAX);
+}
 
-static DWORD g_thread_key = FLS_OUT_OF_INDEXES;
+/*
+ *  Compact mutex functions
+ *
+ *  Parked threads wait on a node on their own stack, queued in
+ *  the bucket of the mutex address. CMTX_PARKED is only changed
+ *  (and checked before queuing) under the bucket lock, so the
+ *  unlocking thread knows whether it has to leave it set for
+ *  the threads still queued. Unlocking releases the mutex and
+ *  wakes the first of them, which then competes for it like
+ *  any other thread.
+ */
 
-static struct thread* g_main_thread = NULL;
+#define CMTX_PARKING_BITS 8
 
-static void call_tss_destructors(struct thread*);
+struct cmtx_waiter
+{
+    struct cmtx_waiter* next;
+    cmtx_t* mtx;
+    atomic_uint state;
+};
 
-static void __stdcall on_thread_exit(void*);
+struct cmtx_bucket
+{
+    _Alignas(CACHELINE_SIZE) mtx_t lock;
+    struct cmtx_waiter* head;
+    struct cmtx_waiter* tail;
+};
 
-static void on_process_exit(void);
+static struct cmtx_bucket g_cmtx_parking[1 << CMTX_PARKING_BITS];
 
-/*
- *  The Old New Thing - Raymond Chen
- *  A better way to clean up.
- *  https://devblogs.microsoft.com/oldnewthing/20191011-00
- */
+static once_flag g_cmtx_parking_once = ONCE_FLAG_INIT;
 
-static void on_process_enter(void)
+static void init_cmtx_parking(void)
 {
-    g_thread_key = FlsAlloc(on_thread_exit);
-    if (g_thread_key == FLS_OUT_OF_INDEXES)
-        abort();
-    atexit(on_process_exit);
+    for (size_t i = 0; i < (1 << CMTX_PARKING_BITS); i++)
+        mtx_init(&g_cmtx_parking[i].lock, mtx_plain);
 }
 
-static inline void set_current_thread(struct thread* thrd)
+static struct cmtx_bucket* lock_cmtx_bucket(cmtx_t* mtx)
 {
-    call_once(&g_once_flag, on_process_enter);
-    FlsSetValue(g_thread_key, thrd);
+    uint32_t hash = (uint32_t)(uintptr_t)mtx * 2654435769U;
+    struct cmtx_bucket* bucket
+        = &g_cmtx_parking[hash >> (32 - CMTX_PARKING_BITS)];
+    call_once(&g_cmtx_parking_once, init_cmtx_parking);
+    mtx_lock(&bucket->lock);
+    return bucket;
 }
 
-static inline struct thread* get_current_thread(void)
-{
-    call_once(&g_once_flag, on_process_enter);
-    return FlsGetValue(g_thread_key);
-}
+/*
+ *  Removes node (or, without one, the first waiter for mtx) from
+ *  the queue. *more tells whether other waiters for mtx remain.
+ */
 
-static unsigned __stdcall start_thread(void* arg)
+static struct cmtx_waiter* dequeue_waiter(struct cmtx_bucket* bucket
+    , cmtx_t* mtx, struct cmtx_waiter* node, int* more)
 {
-    struct thread_param* param = arg;
-    thrd_start_t proc = param->proc;
-    void* data = param->data;
-    set_current_thread(param->thrd);
-    SetEvent(param->entry_event);
-    return proc(data);
+    struct cmtx_waiter* found = NULL;
+    struct cmtx_waiter* prev = NULL;
+    *more = 0;
+    for (struct cmtx_waiter* it = bucket->head; it; it = it->next)
+    {
+        if (found)
+        {
+            if (it->mtx == mtx)
+            {
+                *more = 1;
+                break;
+            }
+        }
+        else if (node ? (it == node) : (it->mtx == mtx))
+        {
+            found = it;
+            if (prev)
+                prev->next = it->next;
+            else
+                bucket->head = it->next;
+            if (bucket->tail == it)
+                bucket->tail = prev;
+            continue;
+        }
+        prev = it;
+    }
+    return found;
 }
 
-int thrd_create(thrd_t* thr, int (*func)(void*), void* arg)
+static int park_cmtx(cmtx_t* mtx, const struct timespec* ts)
 {
-    struct thread* thrd = _aligned_malloc(sizeof(*thrd), CACHELINE_SIZE);
-    if (thrd == NULL)
-        return thrd_nomem;
-    memset(thrd, 0, sizeof(*thrd));
-    int rollback = 1;
-    HANDLE entry_event = CreateEventW(NULL, TRUE, FALSE, NULL);
-    if (entry_event == NULL)
-        goto failure;
-    rollback = 2;
-    struct thread_param param = { 0 };
-    param.proc = func;
-    param.data = arg;
-    param.entry_event = entry_event;
-    param.thrd = thrd;
-    unsigned int id = 0;
-    uintptr_t hnd = _beginthreadex(NULL, 0, start_thread
-        , &param, CREATE_SUSPENDED, &id);
-    if (hnd == 0)
-        goto failure;
-    rollback = 3;
-    thrd->hnd = (HANDLE)hnd;
-    thrd->id = id;
-    thrd->state = st_running;
-    if (ResumeThread(thrd->hnd) == (DWORD)-1)
-        goto failure;
-    if (WaitForSingleObject(entry_event, INFINITE) == WAIT_FAILED)
-        goto failure;
-    CloseHandle(entry_event);
-    *thr = (thrd_t)thrd;
-    return thrd_success;
-failure:
-    switch (rollback)
+    struct cmtx_waiter node = { NULL, mtx, 0 };
+    struct cmtx_bucket* bucket = lock_cmtx_bucket(mtx);
+    if (atomic_load_explicit(&mtx->state, memory_order_relaxed)
+        != (CMTX_LOCKED | CMTX_PARKED))
     {
-    case 3: CloseHandle(thrd->hnd);
-    case 2: CloseHandle(entry_event);
-    case 1: _aligned_free(thrd);
+        mtx_unlock(&bucket->lock);
+        return thrd_success;
     }
-    return thrd_error;
-}
+    if (bucket->tail)
+        bucket->tail->next = &node;
+    else
+        bucket->head = &node;
+    bucket->tail = &node;
+    mtx_unlock(&bucket->lock);
 
-thrd_t thrd_current(void)
-{
-    struct thread* thrd = get_current_thread();
-    if (thrd == NULL)
+    while (atomic_load_explicit(&node.state, memory_order_acquire) == 0)
     {
-        if (g_main_thread)
-            abort();
-        thrd = _aligned_malloc(sizeof(*thrd), CACHELINE_SIZE);
-        if (thrd == NULL)
-            abort();
-        memset(thrd, 0, sizeof(*thrd));
-        if (!DuplicateHandle(GetCurrentProcess()
-            , GetCurrentThread(), GetCurrentProcess()
-            , &thrd->hnd, 0, FALSE, DUPLICATE_SAME_ACCESS))
+        if (futex_wait(&node.state, 0, ts) != ETIMEDOUT)
+            continue;
+        bucket = lock_cmtx_bucket(mtx);
+        int more = 0;
+        if (dequeue_waiter(bucket, mtx, &node, &more))
         {
-            _aligned_free(thrd);
-            abort();
+            if (!more)
+            {
+                atomic_fetch_and_explicit(&mtx->state
+                    , (unsigned char)~CMTX_PARKED, memory_order_relaxed);
+            }
+            mtx_unlock(&bucket->lock);
+            return thrd_timedout;
         }
-        thrd->id = GetThreadId(thrd->hnd);
-        thrd->state = st_detached;
-        g_main_thread = thrd;
-        set_current_thread(thrd);
+        mtx_unlock(&bucket->lock);
+        ts = NULL;
     }
-    return (thrd_t)thrd;
+    return thrd_success;
 }
 
-int thrd_detach(thrd_t thr)
+int cmtx_lock_slow(cmtx_t* mtx, const struct timespec* ts)
 {
-    struct thread* thrd = (struct thread*)thr;
-    LONG state = InterlockedCompareExchange(&thrd->state
-        , st_detached, st_running);
-    assert(state == st_running || state == st_finished);
-    if (!CloseHandle(thrd->hnd))
-        return thrd_error;
-    if (state == st_finished)
+    int spins = 0;
+    for (;;)
     {
-        free(thrd->tss.values);
-        _aligned_free(thrd);
+        unsigned char state = atomic_load_explicit(&mtx->state
+            , memory_order_relaxed);
+        if (!(state & CMTX_LOCKED))
+        {
+            if (atomic_compare_exchange_weak_explicit(&mtx->state, &state
+                , state | CMTX_LOCKED, memory_order_acquire
+                , memory_order_relaxed))
+                return thrd_success;
+            continue;
+        }
+        if (!(state & CMTX_PARKED) && spins < MTX_SPIN_LIMIT)
+        {
+            spins++;
+            thrd_cpu_relax();
+            continue;
+        }
+        if (!(state & CMTX_PARKED)
+            && !atomic_compare_exchange_weak_explicit(&mtx->state, &state
+                , state | CMTX_PARKED, memory_order_relaxed
+                , memory_order_relaxed))
+            continue;
+        if (park_cmtx(mtx, ts) == thrd_timedout)
+            return thrd_timedout;
     }
-    return thrd_success;
 }
 
-int thrd_equal(thrd_t thr0, thrd_t thr1)
-{
-    struct thread* lhs = (struct thread*)thr0;
-    struct thread* rhs = (struct thread*)thr1;
-    return (lhs->id == rhs->id);
-}
+/*
+ *  The woken thread may return (and its node go away) as soon as
+ *  it sees the state change. futex_wake only uses the address.
+ */
 
-int thrd_join(thrd_t thr, int* res)
+void cmtx_unlock_slow(cmtx_t* mtx)
 {
-    struct thread* thrd = (struct thread*)thr;
-    if (GetCurrentThreadId() == thrd->id)
-        return thrd_error;
-    LONG state = InterlockedCompareExchange(&thrd->state
-        , st_joined, st_running);
-    if (state == st_detached)
-        return thrd_error;
-    assert(state == st_running || state == st_finished);
-    if (WaitForSingleObject(thrd->hnd, INFINITE) == WAIT_FAILED)
-        return thrd_error;
-    if (res)
+    struct cmtx_bucket* bucket = lock_cmtx_bucket(mtx);
+    int more = 0;
+    struct cmtx_waiter* node = dequeue_waiter(bucket, mtx, NULL, &more);
+    atomic_store_explicit(&mtx->state, more ? CMTX_PARKED : 0
+        , memory_order_release);
+    mtx_unlock(&bucket->lock);
+    if (node)
     {
-        if (!GetExitCodeThread(thrd->hnd, (LPDWORD)res))
-            return thrd_error;
+        atomic_store_explicit(&node->state, 1, memory_order_release);
+        futex_wake(&node->state, 1);
     }
-    if (!CloseHandle(thrd->hnd))
-        return thrd_error;
-    if (thrd->tss.values)
-        free(thrd->tss.values);
-    _aligned_free(thrd);
-    return thrd_success;
 }
 
 /*
- *  7.26.6 Thread-specific storage functions
+ *  Barrier functions
  */
 
-static struct
-{
-    SRWLOCK lock;
-    tss_dtor_t* dtors;
-    size_t capacity;
-    size_t size;
-    size_t next_avail;
-} g_tss_sweeper = { SRWLOCK_INIT, NULL, 0, 0, 0 };
-
-#define INVALID_TSS_KEY ((size_t)-1)
-#define INVALID_TSS_DTOR ((tss_dtor_t)1)
+#define BARRIER_SENSE 1
+#define BARRIER_WAITERS 2
 
-static size_t find_available_key(void)
+int thrd_barrier_wait(thrd_barrier_t* barrier)
 {
-    for (size_t i = g_tss_sweeper.next_avail
-        ; i != g_tss_sweeper.size; i++)
+    unsigned int sense = atomic_load_explicit(&barrier->phase
+        , memory_order_relaxed) & BARRIER_SENSE;
+    if (atomic_fetch_sub_explicit(&barrier->arrived, 1
+        , memory_order_acq_rel) == 1)
     {
-        if (g_tss_sweeper.dtors[i] == NULL)
-            return i;
-    }
-    for (size_t i = 0; i != g_tss_sweeper.next_avail; i++)
-    {
-        if (g_tss_sweeper.dtors[i] == NULL)
-            return i;
+        if (barrier->completion)
+            barrier->completion(barrier->arg);
+        atomic_store_explicit(&barrier->arrived, barrier->count
+            , memory_order_relaxed);
+        if (atomic_exchange_explicit(&barrier->phase, sense ^ BARRIER_SENSE
+            , memory_order_release) & BARRIER_WAITERS)
+            futex_wake(&barrier->phase, INT_MAX);
+        return thrd_success;
     }
-    return INVALID_TSS_KEY;
-}
-
-static size_t allocate_key(void)
-{
-    if (g_tss_sweeper.size == g_tss_sweeper.capacity)
+    unsigned int phase = 0;
+    for (int i = 0; i < BARRIER_SPIN_LIMIT; i++)
     {
-        size_t capacity = g_tss_sweeper.capacity + 8;
-        size_t nbtotal = capacity * sizeof(void*);
-        tss_dtor_t* addr = realloc(g_tss_sweeper.dtors, nbtotal);
-        if (addr == NULL)
-            return INVALID_TSS_KEY;
-        g_tss_sweeper.dtors = addr;
-        g_tss_sweeper.capacity = capacity;
+        phase = atomic_load_explicit(&barrier->phase, memory_order_acquire);
+        if ((phase & BARRIER_SENSE) != sense)
+            return thrd_success;
+        thrd_cpu_relax();
     }
-    size_t key = g_tss_sweeper.size++;
-    g_tss_sweeper.next_avail = g_tss_sweeper.size;
-    return key;
-}
-
-int tss_create(tss_t* key, tss_dtor_t dtor)
-{
-    AcquireSRWLockExclusive(&g_tss_sweeper.lock);
-    size_t k = find_available_key();
-    if (k == INVALID_TSS_KEY)
-        k = allocate_key();
-    if (k == INVALID_TSS_KEY)
+    while ((phase & BARRIER_SENSE) == sense)
     {
-        ReleaseSRWLockExclusive(&g_tss_sweeper.lock);
-        return thrd_nomem;
+        if (!(phase & BARRIER_WAITERS)
+            && !atomic_compare_exchange_weak_explicit(&barrier->phase
+                , &phase, phase | BARRIER_WAITERS, memory_order_acquire
+                , memory_order_acquire))
+            continue;
+        if (futex_wait(&barrier->phase, sense | BARRIER_WAITERS
+            , NULL) == EINVAL)
+            return thrd_error;
+        phase = atomic_load_explicit(&barrier->phase, memory_order_acquire);
     }
-    *(size_t*)key = k;
-    if (dtor)
-        g_tss_sweeper.dtors[k] = dtor;
-    else
-        g_tss_sweeper.dtors[k] = INVALID_TSS_DTOR;
-    ReleaseSRWLockExclusive(&g_tss_sweeper.lock);
     return thrd_success;
 }
 
-void tss_delete(tss_t key)
+#if defined(C11_THREADS_STATS)
+
+/*
+ *  Contention statistics functions
+ */
+
+void mtx_setname(mtx_t* mtx, const char* name)
 {
-    size_t k = (size_t)key;
-    assert(k < g_tss_sweeper.size);
-    AcquireSRWLockExclusive(&g_tss_sweeper.lock);
-    g_tss_sweeper.dtors[k] = NULL;
-    if (g_tss_sweeper.next_avail > k)
-        g_tss_sweeper.next_avail = k;
-    ReleaseSRWLockExclusive(&g_tss_sweeper.lock);
+#if defined(HAVE_FUTEX)
+    mtx_lock(&g_stats_lock);
+    mtx->stats.name = name;
+    mtx_unlock(&g_stats_lock);
+#else
+    (void)mtx;
+    (void)name;
+#endif /* defined(HAVE_FUTEX) */
 }
 
-void* tss_get(tss_t key)
+void cnd_setname(cnd_t* cond, const char* name)
 {
-    struct thread* thrd = get_current_thread();
-    assert(thrd);
-    size_t k = (size_t)key;
-    if (k >= thrd->tss.capacity)
-        return NULL;
-    return thrd->tss.values[k];
+#if defined(HAVE_FUTEX)
+    mtx_lock(&g_stats_lock);
+    cond->stats.name = name;
+    mtx_unlock(&g_stats_lock);
+#else
+    (void)cond;
+    (void)name;
+#endif /* defined(HAVE_FUTEX) */
 }
 
-int tss_set(tss_t key, void* val)
+void thrd_stats_foreach(void (*func)(const struct thrd_stats*, void*)
+    , void* arg)
 {
-    struct thread* thrd = get_current_thread();
-    assert(thrd);
-    size_t k = (size_t)key;
-    if (k >= thrd->tss.capacity)
-    {
-        size_t capacity = (((k + 1) + 7) & ~7);
-        size_t nbtotal = capacity * sizeof(void*);
-        void** addr = realloc(thrd->tss.values, nbtotal);
-        if (addr == NULL)
-            return thrd_nomem;
-        thrd->tss.values = addr;
-        thrd->tss.capacity = capacity;
-    }
-    thrd->tss.values[k] = val;
-    return thrd_success;
+#if defined(HAVE_FUTEX)
+    mtx_lock(&g_stats_lock);
+    for (struct thrd_stats* stats = g_stats; stats; stats = stats->next)
+        func(stats, arg);
+    mtx_unlock(&g_stats_lock);
+#else
+    (void)func;
+    (void)arg;
+#endif /* defined(HAVE_FUTEX) */
 }
 
-static void call_tss_destructors(struct thread* thrd)
+static void dump_histogram(FILE* stream, const char* label
+    , const atomic_ullong* hist)
 {
-    int stop = 0;
-    for (int i = 0; !stop && i < TSS_DTOR_ITERATIONS; i++)
+    fprintf(stream, "    %s", label);
+    for (int i = 0; i < THRD_STATS_BUCKETS; i++)
     {
-        stop = 1;
-        for (size_t k = 0; k < thrd->tss.capacity; k++)
-        {
-            void* val = thrd->tss.values[k];
-            if (val)
-            {
-                AcquireSRWLockShared(&g_tss_sweeper.lock);
-                tss_dtor_t dtor = g_tss_sweeper.dtors[k];
-                if (!(dtor == NULL || dtor == INVALID_TSS_DTOR))
-                {
-                    thrd->tss.values[k] = NULL;
-                    dtor(val);
-                    stop = 0;
-                }
-                ReleaseSRWLockShared(&g_tss_sweeper.lock);
-            }
-        }
+        unsigned long long count = atomic_load_explicit(&hist[i]
+            , memory_order_relaxed);
+        if (count)
+            fprintf(stream, " %llu:%llu", 1ULL << i, count);
     }
+    fputc('\n', stream);
 }
 
-static void __stdcall on_thread_exit(void* arg)
+static void dump_stats(const struct thrd_stats* stats, void* arg)
 {
-    assert(arg);
-    struct thread* thrd = arg;
-    call_tss_destructors(thrd);
-    set_current_thread(NULL);
-    LONG state = InterlockedCompareExchange(&thrd->state
-        , st_finished, st_running);
-    assert(state != st_finished);
-    if (state == st_detached)
-    {
-        if (thrd->tss.values)
-            free(thrd->tss.values);
-        _aligned_free(thrd);
-    }
+    FILE* stream = arg;
+    const char* kind = (stats->kind == thrd_stats_cnd) ? "cnd" : "mtx";
+    if (stats->name)
+        fprintf(stream, "%s %s\n", kind, stats->name);
+    else
+        fprintf(stream, "%s %p\n", kind, stats->lock);
+    fprintf(stream, "    acquisitions %llu contended %llu busy %llu"
+        " timeouts %llu wait %llu ns (max %llu ns)\n"
+        , atomic_load_explicit(&stats->acquisitions, memory_order_relaxed)
+        , atomic_load_explicit(&stats->contended, memory_order_relaxed)
+        , atomic_load_explicit(&stats->busy, memory_order_relaxed)
+        , atomic_load_explicit(&stats->timeouts, memory_order_relaxed)
+        , atomic_load_explicit(&stats->wait_total, memory_order_relaxed)
+        , atomic_load_explicit(&stats->wait_max, memory_order_relaxed));
+    dump_histogram(stream, "wait ns", stats->wait_hist);
+    if (stats->kind == thrd_stats_mtx)
+        dump_histogram(stream, "hold ns", stats->hold_hist);
 }
 
-static void on_process_exit(void)
+void thrd_stats_dump(FILE* stream)
 {
-    if (g_main_thread)
-        call_tss_destructors(g_main_thread);
-    FlsFree(g_thread_key);
+    thrd_stats_foreach(dump_stats, stream);
 }
 
-#endif /* defined(HAVE_POSIX_THREADS) ... */
+#endif /* defined(C11_THREADS_STATS) */
 
-#endif /* defined(HAVE_THREADS_H_WORKAROUND) */
+#endif /* !defined(HAVE_THREADS_H) */
@@ -26,49 +26,241 @@
 #   error Threads are not supported on your platform!
 #endif /* defined(__linux__) ... */
 
+#include <limits.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <c11/stdatomic.h>
 #include <c11/time.h>
 
+#if defined(C11_THREADS_STATS)
+#   include <stdio.h>
+#endif /* defined(C11_THREADS_STATS) */
+
+/*
+ *  Linux uses futexes for mtx_t and cnd_t. Define C11_NO_FUTEX to
+ *  build them on top of pthreads instead. Only that backend uses
+ *  pthread_cond_clockwait and pthread_mutex_clocklock (glibc 2.30
+ *  and later, HAVE_CLOCKWAIT), the futex one waits on any clock.
+ */
+
 #if defined(HAVE_POSIX_THREADS)
 #   include <errno.h>
 #   include <pthread.h>
 #   include <sched.h>
 #   include <unistd.h>
-#   if defined(_POSIX_TIMEOUTS) && (_POSIX_TIMEOUTS >= 200112L)
+#   if defined(__linux__) && !defined(C11_NO_FUTEX)
+#       define HAVE_FUTEX 1
+#   elif defined(_POSIX_TIMEOUTS) && (_POSIX_TIMEOUTS >= 200112L)
 #       define HAVE_TIMEDLOCK 1
-#   endif /* defined(_POSIX_TIMEOUTS) ... */
+#   endif /* defined(__linux__) */
+#   if defined(__GLIBC__) && ((__GLIBC__ > 2) \
+        || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 30)))
+#       define HAVE_CLOCKWAIT 1
+#   endif /* defined(__GLIBC__) ... */
 #elif defined(HAVE_WINDOWS_THREADS)
 #   include <process.h>
 #   define WIN32_LEAN_AND_MEAN  1
 #   include <windows.h>
+#   if defined(_WIN32_WINNT) && (_WIN32_WINNT >= 0x0602)
+#       define HAVE_WAIT_ON_ADDRESS 1
+#   endif /* defined(_WIN32_WINNT) ... */
 #endif /* defined(HAVE_POSIX_THREADS) */
 
+/*
+ *  Windows has no thread-specific storage with destructors, it
+ *  is emulated. Define C11_EMULATED_TSS to use the emulation
+ *  with POSIX threads as well. Define C11_DLL when threads.c is
+ *  built into a DLL, thread-local variables can't be shared
+ *  across its boundary, so tss_get and tss_set aren't inline.
+ */
+
+#if defined(HAVE_WINDOWS_THREADS) || defined(C11_EMULATED_TSS)
+#   define HAVE_EMULATED_TSS 1
+#endif /* defined(HAVE_WINDOWS_THREADS) ... */
+
+/*
+ *  CPU hint for spin-wait loops (non-standard)
+ */
+
+static inline void thrd_cpu_relax(void)
+{
+#if defined(_MSC_VER)
+    YieldProcessor();
+#elif defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif /* defined(_MSC_VER) */
+}
+
 /*
  *  7.26.1.3 Macros
  */
 
 #define thread_local _Thread_local
 
+#define ONCE_FLAG_INIT { 0 }
+
 #if defined(HAVE_POSIX_THREADS)
-#   define ONCE_FLAG_INIT PTHREAD_ONCE_INIT
 #   define TSS_DTOR_ITERATIONS PTHREAD_DESTRUCTOR_ITERATIONS
 #elif defined(HAVE_WINDOWS_THREADS)
-#   define ONCE_FLAG_INIT INIT_ONCE_STATIC_INIT
 #   define TSS_DTOR_ITERATIONS 4
 #endif /* defined(HAVE_POSIX_THREADS) */
 
+/*
+ *  Upper bound for the spin phase of mtx_adaptive mutexes
+ */
+
+#if !defined(MTX_SPIN_LIMIT)
+#   define MTX_SPIN_LIMIT 100
+#endif /* !defined(MTX_SPIN_LIMIT) */
+
+#if !defined(CACHELINE_SIZE)
+#   define CACHELINE_SIZE 64
+#endif /* !defined(CACHELINE_SIZE) */
+
+/*
+ *  Number of iterations thrd_barrier_wait spins before blocking
+ */
+
+#if !defined(BARRIER_SPIN_LIMIT)
+#   define BARRIER_SPIN_LIMIT 1000
+#endif /* !defined(BARRIER_SPIN_LIMIT) */
+
+/*
+ *  Size of the CPU affinity mask of thrd_attr_t in 64-bit words
+ */
+
+#if !defined(THRD_CPU_WORDS)
+#   define THRD_CPU_WORDS 4
+#endif /* !defined(THRD_CPU_WORDS) */
+
+/*
+ *  Number of keys of the emulated thread-specific storage
+ *  (a multiple of 64, at most 1 << TSS_INDEX_BITS)
+ */
+
+#if !defined(TSS_KEYS_MAX)
+#   define TSS_KEYS_MAX 1024
+#endif /* !defined(TSS_KEYS_MAX) */
+
+#define TSS_INDEX_BITS 16
+
 /*
  *  7.26.1.4 Types
  */
 
+#if defined(HAVE_FUTEX)
+
+/*
+ *  Queue node of an mtx_fair waiter (MCS). The mutex embeds
+ *  the node of its current owner as head.
+ */
+
+struct mtx_waiter
+{
+    _Atomic(struct mtx_waiter*) next;
+    atomic_uint state;
+};
+
+#endif /* defined(HAVE_FUTEX) */
+
+#if defined(C11_THREADS_STATS)
+
+/*
+ *  Contention statistics (non-standard) of an mtx_t or cnd_t,
+ *  collected by the futex backend. Times are in nanoseconds,
+ *  histogram bucket i counts times in [2^i, 2^(i+1)) and the
+ *  last bucket everything above. For a cnd_t acquisitions are
+ *  the waits. Hold times are only taken for contended mutex
+ *  acquisitions, which are the ones that build convoys, so an
+ *  uncontended lock just bumps a counter.
+ */
+
+#define THRD_STATS_BUCKETS 32
+
+struct thrd_stats
+{
+    struct thrd_stats* next;
+    struct thrd_stats* prev;
+    const void* lock;
+    const char* name;
+    int kind;
+    atomic_ullong acquisitions;
+    atomic_ullong contended;
+    atomic_ullong busy;
+    atomic_ullong timeouts;
+    atomic_ullong wait_total;
+    atomic_ullong wait_max;
+    atomic_ullong wait_hist[THRD_STATS_BUCKETS];
+    atomic_ullong hold_hist[THRD_STATS_BUCKETS];
+    unsigned long long hold_start;
+};
+
+#endif /* defined(C11_THREADS_STATS) */
+
 #if defined(HAVE_POSIX_THREADS)
 
+#if !defined(HAVE_FUTEX)
+
 typedef pthread_cond_t cnd_t;
 
+#endif /* !defined(HAVE_FUTEX) */
+
 typedef pthread_t thrd_t;
 
+#if defined(HAVE_EMULATED_TSS)
+
+typedef intptr_t tss_t;
+
+#else
+
 typedef pthread_key_t tss_t;
 
+#endif /* defined(HAVE_EMULATED_TSS) */
+
+#if defined(HAVE_FUTEX)
+
+/*
+ *  state is the futex word: 0 unlocked, 1 locked, 2 locked
+ *  and (possibly) contended. owner and count are only used
+ *  by recursive mutexes, spins only by adaptive ones. Fair
+ *  mutexes queue up on tail instead and keep state at 3, so
+ *  that the inline fast paths always fall through.
+ */
+
+typedef struct
+{
+    atomic_uint state;
+    int type;
+    atomic_uintptr_t owner;
+    unsigned count;
+    atomic_int spins;
+    _Atomic(struct mtx_waiter*) tail;
+    struct mtx_waiter head;
+#if defined(C11_THREADS_STATS)
+    struct thrd_stats stats;
+#endif /* defined(C11_THREADS_STATS) */
+} mtx_t;
+
+/*
+ *  seq is the futex word waiters sleep on, it is bumped by
+ *  every signal and broadcast. mtx is the mutex the waiters
+ *  passed to cnd_wait, so that they can be requeued onto it.
+ */
+
+typedef struct
+{
+    atomic_uint seq;
+    atomic_uint waiters;
+    _Atomic(mtx_t*) mtx;
+#if defined(C11_THREADS_STATS)
+    struct thrd_stats stats;
+#endif /* defined(C11_THREADS_STATS) */
+} cnd_t;
+
+#else
+
 typedef struct
 {
     pthread_mutex_t mtx;
@@ -78,19 +270,16 @@ typedef struct
     unsigned count;
     short locked;
     short type;
+    int spins;
 #endif /* !defined(HAVE_TIMEDLOCK) */
 } mtx_t;
 
-typedef pthread_once_t once_flag;
+#endif /* defined(HAVE_FUTEX) */
 
 #elif defined(HAVE_WINDOWS_THREADS)
 
 typedef CONDITION_VARIABLE cnd_t;
 
-#if !defined(CACHELINE_SIZE)
-#   define CACHELINE_SIZE 64
-#endif /* !definedCACHELINE_SIZE) */
-
 typedef intptr_t thrd_t;
 
 typedef intptr_t tss_t;
@@ -103,25 +292,225 @@ typedef struct
     DWORD count;
     int locked;
     int type;
+    int spins;
 } mtx_t;
 
-typedef INIT_ONCE once_flag;
-
 #endif /* defined(HAVE_POSIX_THREADS) */
 
+/*
+ *  ONCE_RUNNING is set while the function runs, ONCE_WAITERS
+ *  once other threads wait for it to finish (on a futex).
+ */
+
+#define ONCE_RUNNING 1U
+#define ONCE_WAITERS 2U
+#define ONCE_DONE 4U
+
+typedef struct
+{
+    atomic_uint state;
+} once_flag;
+
+/*
+ *  Reader-writer lock (non-standard). Writers queue up on wmtx.
+ *  In the default mode readers are counted in state, with
+ *  rwl_scalable every reader only touches the stripe (one per
+ *  cache line) of the CPU it is running on.
+ */
+
+struct rwl_stripe
+{
+    _Alignas(CACHELINE_SIZE) atomic_uint readers;
+};
+
+typedef struct
+{
+    atomic_uint state;
+    atomic_uint drain;
+    int type;
+    unsigned int mask;
+    struct rwl_stripe* stripes;
+    mtx_t wmtx;
+} rwl_t;
+
+/*
+ *  Future (non-standard): a single result handed from one thread
+ *  to others. state is the word waiters park on, continuations
+ *  are kept in a lock-free stack. A zero-initialized future_t is
+ *  a valid, pending future.
+ */
+
+struct future_callback;
+
+typedef struct
+{
+    atomic_uint state;
+    void* value;
+    _Atomic(struct future_callback*) callbacks;
+} future_t;
+
+typedef void (*future_callback_t)(void* value, void* arg);
+
+/*
+ *  Counting semaphore (non-standard). Threads only block (on
+ *  count) when there are no permits left, waiters tells post
+ *  whether anybody needs to be woken up.
+ */
+
+typedef struct
+{
+    atomic_uint count;
+    atomic_uint waiters;
+} sema_t;
+
+/*
+ *  Latch (non-standard): a one-shot countdown. state holds twice
+ *  the count, its low bit gets set by threads about to block.
+ *  The arrival that brings the count to zero learns from that
+ *  same operation whether to wake anybody, so it doesn't touch
+ *  the latch afterwards (waiters may already have freed it).
+ */
+
+typedef struct
+{
+    atomic_uint state;
+} latch_t;
+
+/*
+ *  Compact mutex (non-standard): a single byte, meant to be
+ *  embedded in large numbers of objects. Threads that have to
+ *  wait are queued in a global parking lot hashed by address,
+ *  CMTX_PARKED tells the owner to look there when unlocking.
+ *  Not recursive, no timed mode needed for cmtx_timedlock.
+ */
+
+#define CMTX_LOCKED 1
+#define CMTX_PARKED 2
+
+#define CMTX_INITIALIZER { 0 }
+
+typedef struct
+{
+    atomic_uchar state;
+} cmtx_t;
+
+/*
+ *  Barrier (non-standard). The last thread to arrive resets
+ *  arrived and flips the sense bit of phase, which the others
+ *  spin (and eventually block) on. A second bit of phase tells
+ *  it whether anybody is blocked.
+ */
+
+typedef void (*thrd_barrier_completion_t)(void* arg);
+
+typedef struct
+{
+    _Alignas(CACHELINE_SIZE) atomic_uint arrived;
+    _Alignas(CACHELINE_SIZE) atomic_uint phase;
+    unsigned int count;
+    thrd_barrier_completion_t completion;
+    void* arg;
+} thrd_barrier_t;
+
 typedef void (*tss_dtor_t)(void*);
 
+#if defined(HAVE_EMULATED_TSS)
+
+/*
+ *  Values of the emulated thread-specific storage, indexed by
+ *  the low TSS_INDEX_BITS of the key, the other bits count how
+ *  often the index has been handed out. A slot only belongs to
+ *  a key if it was set with exactly that key, so a deleted key
+ *  leaves nothing behind for the next one with the same index
+ *  and tss_delete never has to touch other threads' blocks.
+ *  dirty marks the slots set since the last destructor pass.
+ */
+
+struct tss_slot
+{
+    tss_t key;
+    void* value;
+};
+
+struct tss_block
+{
+    size_t capacity;
+    uint64_t dirty[TSS_KEYS_MAX / 64];
+    struct tss_slot slots[];
+};
+
+#if !defined(C11_DLL)
+extern _Thread_local struct tss_block* t_tss_block;
+#endif /* !defined(C11_DLL) */
+
+#endif /* defined(HAVE_EMULATED_TSS) */
+
 typedef int (*thrd_start_t)(void*);
 
+/*
+ *  Attributes of thrd_create_ex (non-standard), zero selects the
+ *  default for every member. CPU i is bit i % 64 of affinity
+ *  word i / 64. Only Linux takes any CPU and Windows the first
+ *  64, thrd_create_ex fails with thrd_error for the others. The
+ *  name is truncated to what the platform takes (15 characters
+ *  on Linux).
+ */
+
+typedef struct
+{
+    size_t stack_size;
+    size_t guard_size;
+    const char* name;
+    int policy;
+    int priority;
+    uint64_t affinity[THRD_CPU_WORDS];
+} thrd_attr_t;
+
 /*
  *  7.26.1.5 Enumeration constants
  */
 
+/*
+ *  mtx_adaptive (non-standard) spins for a bounded, self-tuning
+ *  number of iterations before blocking, see MTX_SPIN_LIMIT. The
+ *  pthread mutexes (HAVE_TIMEDLOCK) cannot spin, mtx_init fails
+ *  with thrd_error there.
+ *  mtx_fair (non-standard) hands the mutex over to its waiters
+ *  in FIFO order, each of them spinning on its own queue node.
+ *  It is only available with futexes (HAVE_FUTEX), everywhere
+ *  else mtx_init fails with thrd_error.
+ */
+
 enum
 {
     mtx_plain,
     mtx_recursive,
-    mtx_timed
+    mtx_timed,
+    mtx_adaptive = 4,
+    mtx_fair = 8
+};
+
+enum
+{
+    rwl_plain,
+    rwl_scalable
+};
+
+#if defined(C11_THREADS_STATS)
+
+enum
+{
+    thrd_stats_mtx,
+    thrd_stats_cnd
+};
+
+#endif /* defined(C11_THREADS_STATS) */
+
+enum
+{
+    thrd_sched_other,
+    thrd_sched_fifo,
+    thrd_sched_rr
 };
 
 enum
@@ -137,51 +526,145 @@ enum
  *  7.26.2 Initialization functions
  */
 
-#if defined(HAVE_POSIX_THREADS)
+/*
+ *  Once the function has run, call_once is a single acquire
+ *  load. call_once_begin returns 1 if the caller has to run it
+ *  (and then call call_once_end), 0 after waiting for another
+ *  thread that did.
+ *
+ *  Non-standard: call_once_ex passes arg on to the function.
+ */
+
+int call_once_begin(once_flag* flag);
+
+void call_once_end(once_flag* flag);
 
 static inline void call_once(once_flag* flag, void (*func)(void))
 {
-    pthread_once(flag, func);
+    if (atomic_load_explicit(&flag->state, memory_order_acquire)
+        != ONCE_DONE && call_once_begin(flag))
+    {
+        func();
+        call_once_end(flag);
+    }
 }
 
-#elif defined(HAVE_WINDOWS_THREADS)
+static inline void call_once_ex(once_flag* flag, void (*func)(void*)
+    , void* arg)
+{
+    if (atomic_load_explicit(&flag->state, memory_order_acquire)
+        != ONCE_DONE && call_once_begin(flag))
+    {
+        func(arg);
+        call_once_end(flag);
+    }
+}
 
 /*
- *  C4054: type cast from function pointer to data pointer
- *  C4055: type cast from data pointer to function pointer
+ *  Lock statistics (non-standard)
+ *
+ *  Hooks of the inline mutex and condition variable functions
+ *  below, the statistics are read with thrd_stats_foreach.
  */
 
-#if defined(_MSC_VER)
-#   pragma warning(push)
-#   pragma warning(disable: 4054 4055)
-#endif /* defined(_MSC_VER) */
+#if defined(C11_THREADS_STATS) && defined(HAVE_FUTEX)
+
+void thrd_stats_register(struct thrd_stats* stats, const void* lock
+    , int kind);
+
+void thrd_stats_unregister(struct thrd_stats* stats);
 
-static int __stdcall call_once_callback(PINIT_ONCE init_once
-    , PVOID param, PVOID* context)
+void thrd_stats_unlocked(struct thrd_stats* stats);
+
+/*
+ *  Counters that are only written by the owner of the mutex
+ *  don't need an atomic read-modify-write.
+ */
+
+static inline void thrd_stats_add(atomic_ullong* counter
+    , unsigned long long value)
 {
-    (void)init_once;
-    (void)context;
-    ((void (*)(void))param)();
-    return 1;
+    atomic_store_explicit(counter, atomic_load_explicit(counter
+        , memory_order_relaxed) + value, memory_order_relaxed);
 }
 
-static inline void call_once(once_flag* flag, void (*func)(void))
+#endif /* defined(C11_THREADS_STATS) && defined(HAVE_FUTEX) */
+
+/*
+ *  7.26.3 Condition variable functions
+ */
+
+#if defined(HAVE_FUTEX)
+
+/*
+ *  Signals wake a single waiter, all others are requeued onto
+ *  the mutex (wait morphing) and woken one at a time as the
+ *  mutex gets released.
+ */
+
+int cnd_signal_slow(cnd_t* cond, int count);
+
+static inline int cnd_broadcast(cnd_t* cond)
 {
-     InitOnceExecuteOnce((PINIT_ONCE)flag, call_once_callback
-        , (void*)func, NULL);
+    if (atomic_load_explicit(&cond->waiters, memory_order_relaxed) == 0)
+        return thrd_success;
+    return cnd_signal_slow(cond, INT_MAX);
 }
 
-#if defined(_MSC_VER)
-#   pragma warning(pop)
-#endif /* defined(_MSC_VER) */
+static inline void cnd_destroy(cnd_t* cond)
+{
+#if defined(C11_THREADS_STATS)
+    thrd_stats_unregister(&cond->stats);
+#else
+    (void)cond;
+#endif /* defined(C11_THREADS_STATS) */
+}
 
-#endif /* defined(HAVE_POSIX_THREADS) */
+static inline int cnd_init(cnd_t* cond)
+{
+    atomic_init(&cond->seq, 0);
+    atomic_init(&cond->waiters, 0);
+    atomic_init(&cond->mtx, NULL);
+#if defined(C11_THREADS_STATS)
+    thrd_stats_register(&cond->stats, cond, thrd_stats_cnd);
+#endif /* defined(C11_THREADS_STATS) */
+    return thrd_success;
+}
+
+static inline int cnd_signal(cnd_t* cond)
+{
+    if (atomic_load_explicit(&cond->waiters, memory_order_relaxed) == 0)
+        return thrd_success;
+    return cnd_signal_slow(cond, 1);
+}
 
 /*
- *  7.26.3 Condition variable functions
+ *  Non-standard: unblocks (up to) count waiters
  */
 
-#if defined(HAVE_POSIX_THREADS)
+static inline int cnd_signal_n(cnd_t* cond, int count)
+{
+    if (count <= 0
+        || atomic_load_explicit(&cond->waiters, memory_order_relaxed) == 0)
+        return thrd_success;
+    return cnd_signal_slow(cond, count);
+}
+
+int cnd_clockwait(cnd_t* cond, mtx_t* mtx, int base
+    , const struct timespec* ts);
+
+static inline int cnd_timedwait(cnd_t* cond, mtx_t* mtx
+    , const struct timespec* ts)
+{
+    return cnd_clockwait(cond, mtx, TIME_UTC, ts);
+}
+
+static inline int cnd_wait(cnd_t* cond, mtx_t* mtx)
+{
+    return cnd_clockwait(cond, mtx, TIME_UTC, NULL);
+}
+
+#elif defined(HAVE_POSIX_THREADS)
 
 static inline int cnd_broadcast(cnd_t* cond)
 {
@@ -195,13 +678,7 @@ static inline void cnd_destroy(cnd_t* cond)
     pthread_cond_destroy(cond);
 }
 
-static inline int cnd_init(cnd_t* cond)
-{
-    int res = pthread_cond_init(cond, NULL);
-    if (res == 0)
-        return thrd_success;
-    return (res == ENOMEM) ? thrd_nomem : thrd_error;
-}
+int cnd_init(cnd_t* cond);
 
 static inline int cnd_signal(cnd_t* cond)
 {
@@ -210,61 +687,194 @@ static inline int cnd_signal(cnd_t* cond)
     return thrd_error;
 }
 
+static inline int cnd_signal_n(cnd_t* cond, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (pthread_cond_signal(cond))
+            return thrd_error;
+    }
+    return thrd_success;
+}
+
+int cnd_clockwait(cnd_t* cond, mtx_t* mtx, int base
+    , const struct timespec* ts);
+
 static inline int cnd_timedwait(cnd_t* cond, mtx_t* mtx
     , const struct timespec* ts)
 {
-    int res = pthread_cond_timedwait(cond, &mtx->mtx, ts);
-    if (res == 0)
+    return cnd_clockwait(cond, mtx, TIME_UTC, ts);
+}
+
+static inline int cnd_wait(cnd_t* cond, mtx_t* mtx)
+{
+#if defined(HAVE_TIMEDLOCK)
+    if (pthread_cond_wait(cond, &mtx->mtx) == 0)
         return thrd_success;
-    return (res == ETIMEDOUT) ? thrd_timedout : thrd_error;
+    return thrd_error;
+#else
+    return cnd_clockwait(cond, mtx, TIME_UTC, NULL);
+#endif /* defined(HAVE_TIMEDLOCK) */
+}
+
+#elif defined(HAVE_WINDOWS_THREADS)
+
+static inline int cnd_broadcast(cnd_t* cond)
+{
+    WakeAllConditionVariable(cond);
+    return thrd_success;
+}
+
+static inline void cnd_destroy(cnd_t* cond)
+{
+    (void)cond;
+}
+
+static inline int cnd_init(cnd_t* cond)
+{
+    InitializeConditionVariable(cond);
+    return thrd_success;
+}
+
+static inline int cnd_signal(cnd_t* cond)
+{
+    WakeConditionVariable(cond);
+    return thrd_success;
+}
+
+static inline int cnd_signal_n(cnd_t* cond, int count)
+{
+    for (int i = 0; i < count; i++)
+        WakeConditionVariable(cond);
+    return thrd_success;
+}
+
+int cnd_clockwait(cnd_t* cond, mtx_t* mtx, int base
+    , const struct timespec* ts);
+
+static inline int cnd_timedwait(cnd_t* cond, mtx_t* mtx
+    , const struct timespec* ts)
+{
+    return cnd_clockwait(cond, mtx, TIME_UTC, ts);
+}
+
+static inline int cnd_wait(cnd_t* cond, mtx_t* mtx)
+{
+    return cnd_clockwait(cond, mtx, TIME_UTC, NULL);
+}
+
+#endif /* defined(HAVE_POSIX_THREADS) */
+
+/*
+ *  7.26.4 Mutex functions
+ */
+
+#if defined(HAVE_FUTEX)
+
+/*
+ *  Lock and unlock are a single CAS or exchange as long as
+ *  the mutex is not contended, everything else is handled
+ *  out of line in threads.c.
+ */
+
+int mtx_lock_slow(mtx_t* mtx, int base, const struct timespec* ts);
+
+int mtx_trylock_slow(mtx_t* mtx);
+
+void mtx_unlock_slow(mtx_t* mtx);
+
+static inline void mtx_destroy(mtx_t* mtx)
+{
+#if defined(C11_THREADS_STATS)
+    thrd_stats_unregister(&mtx->stats);
+#else
+    (void)mtx;
+#endif /* defined(C11_THREADS_STATS) */
 }
 
-static inline int cnd_wait(cnd_t* cond, mtx_t* mtx)
+static inline int mtx_init(mtx_t* mtx, int type)
 {
-    if (pthread_cond_wait(cond, &mtx->mtx) == 0)
-        return thrd_success;
-    return thrd_error;
+    atomic_init(&mtx->state, (type & mtx_fair) ? 3 : 0);
+    mtx->type = type;
+    atomic_init(&mtx->owner, 0);
+    mtx->count = 0;
+    atomic_init(&mtx->spins, 0);
+    atomic_init(&mtx->tail, NULL);
+    atomic_init(&mtx->head.next, NULL);
+    atomic_init(&mtx->head.state, 0);
+#if defined(C11_THREADS_STATS)
+    thrd_stats_register(&mtx->stats, mtx, thrd_stats_mtx);
+#endif /* defined(C11_THREADS_STATS) */
+    return thrd_success;
 }
 
-#elif defined(HAVE_WINDOWS_THREADS)
-
-static inline int cnd_broadcast(cnd_t* cond)
+static inline int mtx_acquired(mtx_t* mtx)
 {
-    WakeAllConditionVariable(cond);
+#if defined(C11_THREADS_STATS)
+    thrd_stats_add(&mtx->stats.acquisitions, 1);
+#endif /* defined(C11_THREADS_STATS) */
+    if (mtx->type & mtx_recursive)
+    {
+        atomic_store_explicit(&mtx->owner
+            , (uintptr_t)pthread_self(), memory_order_relaxed);
+        mtx->count = 1;
+    }
     return thrd_success;
 }
 
-static inline void cnd_destroy(cnd_t* cond)
+static inline int mtx_lock(mtx_t* mtx)
 {
-    (void)cond;
+    unsigned int expected = 0;
+    if (atomic_compare_exchange_strong_explicit(&mtx->state, &expected
+        , 1, memory_order_acquire, memory_order_relaxed))
+        return mtx_acquired(mtx);
+    return mtx_lock_slow(mtx, TIME_UTC, NULL);
 }
 
-static inline int cnd_init(cnd_t* cond)
+static inline int mtx_clocklock(mtx_t* mtx, int base
+    , const struct timespec* ts)
 {
-    InitializeConditionVariable(cond);
-    return thrd_success;
+    unsigned int expected = 0;
+    if (atomic_compare_exchange_strong_explicit(&mtx->state, &expected
+        , 1, memory_order_acquire, memory_order_relaxed))
+        return mtx_acquired(mtx);
+    return mtx_lock_slow(mtx, base, ts);
 }
 
-static inline int cnd_signal(cnd_t* cond)
+static inline int mtx_timedlock(mtx_t* mtx, const struct timespec* ts)
 {
-    WakeConditionVariable(cond);
-    return thrd_success;
+    return mtx_clocklock(mtx, TIME_UTC, ts);
 }
 
-int cnd_timedwait(cnd_t* cond, mtx_t* mtx, const struct timespec* ts);
-
-static inline int cnd_wait(cnd_t* cond, mtx_t* mtx)
+static inline int mtx_trylock(mtx_t* mtx)
 {
-    return cnd_timedwait(cond, mtx, NULL);
+    unsigned int expected = 0;
+    if (atomic_compare_exchange_strong_explicit(&mtx->state, &expected
+        , 1, memory_order_acquire, memory_order_relaxed))
+        return mtx_acquired(mtx);
+    return mtx_trylock_slow(mtx);
 }
 
-#endif /* defined(HAVE_POSIX_THREADS) */
-
-/*
- *  7.26.4 Mutex functions
- */
+static inline int mtx_unlock(mtx_t* mtx)
+{
+    if (mtx->type & mtx_recursive)
+    {
+        if (--mtx->count != 0)
+            return thrd_success;
+        atomic_store_explicit(&mtx->owner, 0, memory_order_relaxed);
+    }
+#if defined(C11_THREADS_STATS)
+    if (mtx->stats.hold_start)
+        thrd_stats_unlocked(&mtx->stats);
+#endif /* defined(C11_THREADS_STATS) */
+    unsigned int expected = 1;
+    if (!atomic_compare_exchange_strong_explicit(&mtx->state, &expected
+        , 0, memory_order_release, memory_order_relaxed))
+        mtx_unlock_slow(mtx);
+    return thrd_success;
+}
 
-#if defined(HAVE_POSIX_THREADS) && defined(HAVE_TIMEDLOCK)
+#elif defined(HAVE_POSIX_THREADS) && defined(HAVE_TIMEDLOCK)
 
 static inline void mtx_destroy(mtx_t* mtx)
 {
@@ -273,6 +883,8 @@ static inline void mtx_destroy(mtx_t* mtx)
 
 static inline int mtx_init(mtx_t* mtx, int type)
 {
+    if (type & (mtx_adaptive | mtx_fair))
+        return thrd_error;
     int res = 0;
     if (type & mtx_recursive)
     {
@@ -298,12 +910,14 @@ static inline int mtx_lock(mtx_t* mtx)
     return thrd_error;
 }
 
+int mtx_clocklock(mtx_t* mtx, int base, const struct timespec* ts);
+
 static inline int mtx_timedlock(mtx_t* mtx, const struct timespec* ts)
 {
     int res = pthread_mutex_timedlock(&mtx->mtx, ts);
     if (res == 0)
         return thrd_success;
-    return (res == ETIMEDOUT) ? thrd_busy : thrd_error;
+    return (res == ETIMEDOUT) ? thrd_timedout : thrd_error;
 }
 
 static inline int mtx_trylock(mtx_t* mtx)
@@ -329,6 +943,8 @@ int mtx_init(mtx_t* mtx, int type);
 
 int mtx_lock(mtx_t* mtx);
 
+int mtx_clocklock(mtx_t* mtx, int base, const struct timespec* ts);
+
 int mtx_timedlock(mtx_t* mtx, const struct timespec* ts);
 
 int mtx_trylock(mtx_t* mtx);
@@ -337,19 +953,34 @@ int mtx_unlock(mtx_t* mtx);
 
 #endif /* defined(HAVE_POSIX_THREADS) ... */
 
+/*
+ *  Non-standard: cnd_clockwait and mtx_clocklock take deadlines
+ *  on either TIME_UTC or TIME_MONOTONIC (which isn't affected by
+ *  changes of the system time). thrd_deadline turns a relative
+ *  timeout into such a deadline and returns it.
+ */
+
+static inline struct timespec* thrd_deadline(struct timespec* deadline
+    , int base, const struct timespec* timeout)
+{
+    timespec_get(deadline, base);
+    deadline->tv_sec += timeout->tv_sec;
+    deadline->tv_nsec += timeout->tv_nsec;
+    if (deadline->tv_nsec >= 1000000000L)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
 /*
  *  7.26.5 Thread functions
  */
 
 #if defined(HAVE_POSIX_THREADS)
 
-static inline int thrd_create(thrd_t* thr, thrd_start_t func, void* arg)
-{
-    int res = pthread_create(thr, 0, (void*(*)(void*))func, arg);
-    if (res == 0)
-        return thrd_success;
-    return (res == ENOMEM) ? thrd_nomem : thrd_error;
-}
+int thrd_create(thrd_t* thr, thrd_start_t func, void* arg);
 
 static inline thrd_t thrd_current(void)
 {
@@ -436,14 +1067,15 @@ int thrd_join(thrd_t thr, int* res);
 /*
  *  Neither NtDelayExecution nor SetWaitableTimer deliver
  *  a higher resolution than 15.625 ms (and we don't want
- *  to use timeBeginPeriod/timeEndPeriod).
+ *  to use timeBeginPeriod/timeEndPeriod). Partial milliseconds
+ *  are rounded up, thrd_sleep_precise does better.
  */
 
 static inline int thrd_sleep(const struct timespec* duration
     , struct timespec* remaining)
 {
     __int64 msec = (duration->tv_sec * 1000L
-        + duration->tv_nsec / 1000000L);
+        + (duration->tv_nsec + 999999L) / 1000000L);
     Sleep((DWORD)msec);
     if (remaining)
     {
@@ -461,11 +1093,126 @@ static inline void thrd_yield(void)
 
 #endif /* defined(HAVE_POSIX_THREADS) */
 
+/*
+ *  Non-standard: thrd_create with attributes (attr may be NULL)
+ *
+ *  On Windows the guard size and the scheduling policy are not
+ *  supported, priority is passed on to SetThreadPriority, and
+ *  the affinity is limited to the first 64 CPUs.
+ */
+
+static inline void thrd_attr_init(thrd_attr_t* attr)
+{
+    thrd_attr_t zero = { 0 };
+    *attr = zero;
+}
+
+static inline void thrd_attr_setcpu(thrd_attr_t* attr, unsigned int cpu)
+{
+    if (cpu < THRD_CPU_WORDS * 64)
+        attr->affinity[cpu / 64] |= (uint64_t)1 << (cpu % 64);
+}
+
+int thrd_create_ex(thrd_t* thr, thrd_start_t func, void* arg
+    , const thrd_attr_t* attr);
+
+/*
+ *  Non-standard: number of processors online (at least 1)
+ */
+
+unsigned int thrd_processor_count(void);
+
+/*
+ *  Non-standard: precise sleep
+ *
+ *  thrd_sleep_precise and thrd_sleep_until (deadline on TIME_UTC
+ *  or TIME_MONOTONIC) let the OS sleep until shortly before the
+ *  deadline and spin the rest. Each thread learns how late its
+ *  sleeps wake up and starts spinning that much earlier, but at
+ *  most THRD_SLEEP_SPIN_LIMIT nanoseconds (200 us), so that slow
+ *  timers cannot turn a sleep into a busy wait. On Windows they
+ *  use a high resolution waitable timer per thread (Windows 10
+ *  1803 and later).
+ *
+ *  thrd_timer_slack sets how much the kernel may delay timers of
+ *  the calling thread to batch wakeups (0 restores the default).
+ *  Only Linux has it (PR_SET_TIMERSLACK, 50 us by default).
+ */
+
+#if !defined(THRD_SLEEP_SPIN_NSEC)
+#   define THRD_SLEEP_SPIN_NSEC 200000
+#endif /* !defined(THRD_SLEEP_SPIN_NSEC) */
+
+#if !defined(THRD_SLEEP_SPIN_LIMIT)
+#   define THRD_SLEEP_SPIN_LIMIT 200000
+#endif /* !defined(THRD_SLEEP_SPIN_LIMIT) */
+
+int thrd_sleep_until(int base, const struct timespec* deadline);
+
+int thrd_sleep_precise(const struct timespec* duration);
+
+int thrd_timer_slack(unsigned long nsec);
+
 /*
  *  7.26.6 Thread-specific storage functions
  */
 
-#if defined(HAVE_POSIX_THREADS)
+#if defined(HAVE_EMULATED_TSS)
+
+/*
+ *  A thread that hasn't set anything yet points to an empty
+ *  block, so both fast paths are a load, a bounds check and an
+ *  index. tss_set_slow allocates (or grows) the block.
+ */
+
+int tss_create(tss_t* key, tss_dtor_t dtor);
+
+void tss_delete(tss_t key);
+
+static inline void* tss_block_get(struct tss_block* block, tss_t key)
+{
+    size_t index = (size_t)key & ((1U << TSS_INDEX_BITS) - 1);
+    if (index < block->capacity && block->slots[index].key == key)
+        return block->slots[index].value;
+    return NULL;
+}
+
+int tss_set_slow(tss_t key, void* val);
+
+static inline int tss_block_set(struct tss_block* block, tss_t key
+    , void* val)
+{
+    size_t index = (size_t)key & ((1U << TSS_INDEX_BITS) - 1);
+    if (index >= block->capacity)
+        return tss_set_slow(key, val);
+    block->slots[index].key = key;
+    block->slots[index].value = val;
+    if (val)
+        block->dirty[index / 64] |= (uint64_t)1 << (index % 64);
+    return thrd_success;
+}
+
+#if defined(C11_DLL)
+
+void* tss_get(tss_t key);
+
+int tss_set(tss_t key, void* val);
+
+#else
+
+static inline void* tss_get(tss_t key)
+{
+    return tss_block_get(t_tss_block, key);
+}
+
+static inline int tss_set(tss_t key, void* val)
+{
+    return tss_block_set(t_tss_block, key, val);
+}
+
+#endif /* defined(C11_DLL) */
+
+#elif defined(HAVE_POSIX_THREADS)
 
 static inline int tss_create(tss_t* key, tss_dtor_t dtor)
 {
@@ -491,17 +1238,291 @@ static inline int tss_set(tss_t key, void* val)
     return thrd_error;
 }
 
-#elif defined(HAVE_WINDOWS_THREADS)
+#endif /* defined(HAVE_EMULATED_TSS) */
 
-int tss_create(tss_t* key, tss_dtor_t dtor);
+/*
+ *  Reader-writer lock functions (non-standard)
+ *
+ *  rwl_unlock releases either kind of lock. Read locks are not
+ *  recursive: waiting writers block new readers.
+ */
 
-void tss_delete(tss_t key);
+void rwl_destroy(rwl_t* rwl);
 
-void* tss_get(tss_t key);
+int rwl_init(rwl_t* rwl, int type);
 
-int tss_set(tss_t key, void* val);
+int rwl_rdlock(rwl_t* rwl);
 
-#endif /* defined(HAVE_POSIX_THREADS) */
+int rwl_timedrdlock(rwl_t* rwl, const struct timespec* ts);
+
+int rwl_tryrdlock(rwl_t* rwl);
+
+int rwl_wrlock(rwl_t* rwl);
+
+int rwl_timedwrlock(rwl_t* rwl, const struct timespec* ts);
+
+int rwl_trywrlock(rwl_t* rwl);
+
+int rwl_unlock(rwl_t* rwl);
+
+/*
+ *  Future functions (non-standard)
+ *
+ *  future_set makes the value available to future_get and runs
+ *  the continuations, in the order they were added, on the
+ *  calling thread. Continuations added to a ready future run
+ *  right away on the thread adding them. A future can be set
+ *  only once, further calls fail with thrd_error.
+ */
+
+void future_destroy(future_t* future);
+
+int future_init(future_t* future);
+
+int future_set(future_t* future, void* value);
+
+int future_get(future_t* future, void** value);
+
+int future_timedget(future_t* future, void** value
+    , const struct timespec* ts);
+
+int future_ready(future_t* future);
+
+int future_then(future_t* future, future_callback_t func, void* arg);
+
+/*
+ *  Semaphore functions (non-standard)
+ *
+ *  Taking a permit is a single compare-and-swap on the count as
+ *  long as there are any, posting only makes a system call if a
+ *  thread is blocked.
+ */
+
+int sema_wait_slow(sema_t* sem, const struct timespec* ts);
+
+void sema_wake(sema_t* sem, unsigned int count);
+
+static inline void sema_destroy(sema_t* sem)
+{
+    (void)sem;
+}
+
+static inline int sema_init(sema_t* sem, unsigned int count)
+{
+    atomic_init(&sem->count, count);
+    atomic_init(&sem->waiters, 0);
+    return thrd_success;
+}
+
+static inline int sema_post_n(sema_t* sem, unsigned int count)
+{
+    atomic_fetch_add_explicit(&sem->count, count, memory_order_seq_cst);
+    if (atomic_load_explicit(&sem->waiters, memory_order_seq_cst))
+        sema_wake(sem, count);
+    return thrd_success;
+}
+
+static inline int sema_post(sema_t* sem)
+{
+    return sema_post_n(sem, 1);
+}
+
+static inline int sema_trywait(sema_t* sem)
+{
+    unsigned int count = atomic_load_explicit(&sem->count
+        , memory_order_relaxed);
+    while (count)
+    {
+        if (atomic_compare_exchange_weak_explicit(&sem->count, &count
+            , count - 1, memory_order_acquire, memory_order_relaxed))
+            return thrd_success;
+    }
+    return thrd_busy;
+}
+
+static inline int sema_timedwait(sema_t* sem, const struct timespec* ts)
+{
+    if (sema_trywait(sem) == thrd_success)
+        return thrd_success;
+    return sema_wait_slow(sem, ts);
+}
+
+static inline int sema_wait(sema_t* sem)
+{
+    return sema_timedwait(sem, NULL);
+}
+
+/*
+ *  Latch functions (non-standard)
+ *
+ *  latch_count_down must not take the count below zero. Once it
+ *  is zero the latch stays open, latch_wait returns right away.
+ */
+
+int latch_timedwait(latch_t* latch, const struct timespec* ts);
+
+void latch_wake(latch_t* latch);
+
+static inline void latch_destroy(latch_t* latch)
+{
+    (void)latch;
+}
+
+static inline int latch_init(latch_t* latch, unsigned int count)
+{
+    atomic_init(&latch->state, count * 2);
+    return thrd_success;
+}
+
+static inline int latch_count_down(latch_t* latch, unsigned int count)
+{
+    if (atomic_fetch_sub_explicit(&latch->state, count * 2
+        , memory_order_release) == count * 2 + 1)
+        latch_wake(latch);
+    return thrd_success;
+}
+
+static inline int latch_trywait(latch_t* latch)
+{
+    return (atomic_load_explicit(&latch->state
+        , memory_order_acquire) < 2) ? thrd_success : thrd_busy;
+}
+
+static inline int latch_wait(latch_t* latch)
+{
+    if (latch_trywait(latch) == thrd_success)
+        return thrd_success;
+    return latch_timedwait(latch, NULL);
+}
+
+static inline int latch_arrive_and_wait(latch_t* latch, unsigned int count)
+{
+    latch_count_down(latch, count);
+    return latch_wait(latch);
+}
+
+/*
+ *  Compact mutex functions (non-standard)
+ *
+ *  A cmtx_t initialized with CMTX_INITIALIZER (or zero-filled)
+ *  needs no cmtx_init, there is nothing to destroy either.
+ */
+
+int cmtx_lock_slow(cmtx_t* mtx, const struct timespec* ts);
+
+void cmtx_unlock_slow(cmtx_t* mtx);
+
+static inline void cmtx_destroy(cmtx_t* mtx)
+{
+    (void)mtx;
+}
+
+static inline int cmtx_init(cmtx_t* mtx)
+{
+    atomic_init(&mtx->state, 0);
+    return thrd_success;
+}
+
+static inline int cmtx_trylock(cmtx_t* mtx)
+{
+    unsigned char state = atomic_load_explicit(&mtx->state
+        , memory_order_relaxed);
+    while (!(state & CMTX_LOCKED))
+    {
+        if (atomic_compare_exchange_weak_explicit(&mtx->state, &state
+            , state | CMTX_LOCKED, memory_order_acquire
+            , memory_order_relaxed))
+            return thrd_success;
+    }
+    return thrd_busy;
+}
+
+static inline int cmtx_timedlock(cmtx_t* mtx, const struct timespec* ts)
+{
+    unsigned char expected = 0;
+    if (atomic_compare_exchange_weak_explicit(&mtx->state, &expected
+        , CMTX_LOCKED, memory_order_acquire, memory_order_relaxed))
+        return thrd_success;
+    return cmtx_lock_slow(mtx, ts);
+}
+
+static inline int cmtx_lock(cmtx_t* mtx)
+{
+    return cmtx_timedlock(mtx, NULL);
+}
+
+static inline int cmtx_unlock(cmtx_t* mtx)
+{
+    unsigned char expected = CMTX_LOCKED;
+    if (!atomic_compare_exchange_strong_explicit(&mtx->state, &expected
+        , 0, memory_order_release, memory_order_relaxed))
+        cmtx_unlock_slow(mtx);
+    return thrd_success;
+}
+
+/*
+ *  Barrier functions (non-standard)
+ *
+ *  count threads have to call thrd_barrier_wait to complete a
+ *  phase, after which the barrier can be reused right away. The
+ *  completion function (if any) runs on the last thread to
+ *  arrive, before any of the others return.
+ */
+
+static inline void thrd_barrier_destroy(thrd_barrier_t* barrier)
+{
+    (void)barrier;
+}
+
+static inline int thrd_barrier_init(thrd_barrier_t* barrier
+    , unsigned int count, thrd_barrier_completion_t completion, void* arg)
+{
+    if (count == 0)
+        return thrd_error;
+    atomic_init(&barrier->arrived, count);
+    atomic_init(&barrier->phase, 0);
+    barrier->count = count;
+    barrier->completion = completion;
+    barrier->arg = arg;
+    return thrd_success;
+}
+
+int thrd_barrier_wait(thrd_barrier_t* barrier);
+
+/*
+ *  Waiting on an address (non-standard)
+ *
+ *  The futex, WaitOnAddress or parking lot layer everything above
+ *  blocks on, exported for atomic_wait. thrd_wait_address blocks
+ *  as long as addr holds val, but may also return spuriously.
+ *  thrd_wake_address wakes one or all threads waiting on addr.
+ */
+
+void thrd_wait_address(atomic_uint* addr, unsigned int val);
+
+void thrd_wake_address(atomic_uint* addr, int all);
+
+#if defined(C11_THREADS_STATS)
+
+/*
+ *  Contention statistics functions (non-standard)
+ *
+ *  Names are not copied, they have to outlive the lock. The
+ *  callback of thrd_stats_foreach must not initialize or destroy
+ *  any mutex or condition variable. Without the futex backend
+ *  no statistics are collected and no locks are found.
+ */
+
+void mtx_setname(mtx_t* mtx, const char* name);
+
+void cnd_setname(cnd_t* cond, const char* name);
+
+void thrd_stats_foreach(void (*func)(const struct thrd_stats*, void*)
+    , void* arg);
+
+void thrd_stats_dump(FILE* stream);
+
+#endif /* defined(C11_THREADS_STATS) */
 
 #endif /* defined(HAVE_THREADS_H_WORKAROUND) */
 
@@ -0,0 +1,113 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include <c11/time.h>
+
+#if defined(HAVE_TIMESPEC_GET_WORKAROUND)
+
+#if defined(_WIN32)
+
+/*
+ *  The performance counter and the CPU times come from the
+ *  helpers in c11/time.h.
+ */
+
+#undef timespec_get
+
+int timespec_get_workaround(struct timespec* ts, int base)
+{
+    switch (base)
+    {
+    case TIME_MONOTONIC:
+        return timespec_get_monotonic(ts);
+    case TIME_ACTIVE:
+    case TIME_THREAD_ACTIVE:
+        return timespec_get_active(ts, base);
+    default:
+        return timespec_get(ts, base);
+    }
+}
+
+/*
+ *  The C library reads the precise system time (100 ns units),
+ *  the CPU times advance with the clock interrupt.
+ */
+
+int timespec_getres_workaround(struct timespec* res, int base)
+{
+    long long nsec = 0;
+    switch (base)
+    {
+    case TIME_UTC:
+        nsec = 100;
+        break;
+    case TIME_MONOTONIC:
+        nsec = 1000000000LL / performance_frequency();
+        break;
+    case TIME_ACTIVE:
+    case TIME_THREAD_ACTIVE:
+    {
+        DWORD adjustment = 0, increment = 0;
+        BOOL disabled = FALSE;
+        GetSystemTimeAdjustment(&adjustment, &increment, &disabled);
+        nsec = increment * 100LL;
+        break;
+    }
+    default:
+        return 0;
+    }
+    res->tv_sec = (time_t)(nsec / 1000000000LL);
+    res->tv_nsec = (nsec > 0) ? (long)(nsec % 1000000000LL) : 1L;
+    return base;
+}
+
+#else
+
+static int time_base_to_clock(int base, clockid_t* clock)
+{
+    switch (base)
+    {
+    case TIME_UTC:
+        *clock = CLOCK_REALTIME;
+        return 1;
+    case TIME_MONOTONIC:
+        *clock = CLOCK_MONOTONIC;
+        return 1;
+    case TIME_ACTIVE:
+        *clock = CLOCK_PROCESS_CPUTIME_ID;
+        return 1;
+    case TIME_THREAD_ACTIVE:
+        *clock = CLOCK_THREAD_CPUTIME_ID;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+int timespec_get_workaround(struct timespec* ts, int base)
+{
+    clockid_t clock;
+    if (!time_base_to_clock(base, &clock) || clock_gettime(clock, ts))
+        return 0;
+    return base;
+}
+
+int timespec_getres_workaround(struct timespec* res, int base)
+{
+    clockid_t clock;
+    if (!time_base_to_clock(base, &clock) || clock_getres(clock, res))
+        return 0;
+    return base;
+}
+
+#endif /* defined(_WIN32) */
+
+#endif /* defined(HAVE_TIMESPEC_GET_WORKAROUND) */
@@ -21,7 +21,11 @@
 #if defined(__APPLE__)
 
 #include <time.h>
+#include <sys/resource.h>
 #include <sys/time.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <c11/stdatomic.h>
 
 /*
  *  7.27.1 Components of time
@@ -31,10 +35,34 @@
 #   define TIME_UTC 1
 #endif /* !defined(TIME_UTC) */
 
+#if !defined(TIME_MONOTONIC)
+#   define TIME_MONOTONIC 2
+#endif /* !defined(TIME_MONOTONIC) */
+
+#if !defined(TIME_ACTIVE)
+#   define TIME_ACTIVE 3
+#endif /* !defined(TIME_ACTIVE) */
+
+#if !defined(TIME_THREAD_ACTIVE)
+#   define TIME_THREAD_ACTIVE 4
+#endif /* !defined(TIME_THREAD_ACTIVE) */
+
 #if !defined(CLOCK_REALTIME)
 #   define CLOCK_REALTIME 0
 #endif /* !defined(CLOCK_REALTIME) */
 
+#if !defined(CLOCK_MONOTONIC)
+#   define CLOCK_MONOTONIC 6
+#endif /* !defined(CLOCK_MONOTONIC) */
+
+#if !defined(CLOCK_PROCESS_CPUTIME_ID)
+#   define CLOCK_PROCESS_CPUTIME_ID 12
+#endif /* !defined(CLOCK_PROCESS_CPUTIME_ID) */
+
+#if !defined(CLOCK_THREAD_CPUTIME_ID)
+#   define CLOCK_THREAD_CPUTIME_ID 16
+#endif /* !defined(CLOCK_THREAD_CPUTIME_ID) */
+
 #if !defined(_STRUCT_TIMESPEC)
 
 struct timespec
@@ -49,11 +77,93 @@ struct timespec
  *  7.27.2 Time manipulation functions
  */
 
-static int clock_gettime_workaround(long unused, struct timespec* ts)
+static inline long time_base_to_clock(int base)
+{
+    switch (base)
+    {
+    case TIME_UTC:
+        return CLOCK_REALTIME;
+    case TIME_MONOTONIC:
+        return CLOCK_MONOTONIC;
+    case TIME_ACTIVE:
+        return CLOCK_PROCESS_CPUTIME_ID;
+    case TIME_THREAD_ACTIVE:
+        return CLOCK_THREAD_CPUTIME_ID;
+    default:
+        return -1;
+    }
+}
+
+/*
+ *  numer and denom are published together in one atomic word,
+ *  racing initializations store the same value.
+ */
+
+static inline mach_timebase_info_data_t mach_timebase(void)
+{
+    static volatile atomic_ullong packed = 0;
+    mach_timebase_info_data_t timebase = { 0, 0 };
+    unsigned long long value = atomic_load_explicit(&packed
+        , memory_order_relaxed);
+    if (value == 0)
+    {
+        mach_timebase_info(&timebase);
+        value = ((unsigned long long)timebase.numer << 32) | timebase.denom;
+        atomic_store_explicit(&packed, value, memory_order_relaxed);
+    }
+    timebase.numer = (uint32_t)(value >> 32);
+    timebase.denom = (uint32_t)value;
+    return timebase;
+}
+
+/*
+ *  Before Sierra there is no clock_gettime. TIME_MONOTONIC falls
+ *  back to mach_absolute_time (in ticks of timebase numer/denom
+ *  nanoseconds), the CPU times to getrusage and thread_info.
+ */
+
+static int clock_gettime_workaround(long clock, struct timespec* ts)
 {
-    (void)unused;
+    if (clock == CLOCK_MONOTONIC)
+    {
+        mach_timebase_info_data_t timebase = mach_timebase();
+        uint64_t nsec = mach_absolute_time() * timebase.numer
+            / timebase.denom;
+        ts->tv_sec = (time_t)(nsec / 1000000000ULL);
+        ts->tv_nsec = (long)(nsec % 1000000000ULL);
+        return 0;
+    }
     struct timeval tv = { 0 };
-    gettimeofday(&tv, NULL);
+    if (clock == CLOCK_PROCESS_CPUTIME_ID)
+    {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage))
+            return -1;
+        timeradd(&usage.ru_utime, &usage.ru_stime, &tv);
+    }
+    else if (clock == CLOCK_THREAD_CPUTIME_ID)
+    {
+        thread_basic_info_data_t info;
+        mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+        mach_port_t thread = mach_thread_self();
+        kern_return_t res = thread_info(thread, THREAD_BASIC_INFO
+            , (thread_info_t)&info, &count);
+        mach_port_deallocate(mach_task_self(), thread);
+        if (res != KERN_SUCCESS)
+            return -1;
+        tv.tv_sec = info.user_time.seconds + info.system_time.seconds;
+        tv.tv_usec = info.user_time.microseconds
+            + info.system_time.microseconds;
+        if (tv.tv_usec >= 1000000)
+        {
+            tv.tv_sec++;
+            tv.tv_usec -= 1000000;
+        }
+    }
+    else
+    {
+        gettimeofday(&tv, NULL);
+    }
     ts->tv_sec = tv.tv_sec;
     ts->tv_nsec = tv.tv_usec * 1000L;
     return 0;
@@ -74,7 +184,35 @@ static inline int timespec_get(struct timespec* ts, int base)
         }
         atomic_store(&get_system_time, proc);
     }
-    ((int (*)(long, struct timespec*))proc)(CLOCK_REALTIME, ts);
+    long clock = time_base_to_clock(base);
+    if (clock < 0 || ((int (*)(long, struct timespec*))proc)(clock, ts))
+        return 0;
+    return base;
+}
+
+/*
+ *  The fallbacks count microseconds, except for the monotonic
+ *  one which ticks at the timebase.
+ */
+
+static inline int timespec_getres(struct timespec* res, int base)
+{
+    long clock = time_base_to_clock(base);
+    if (clock < 0)
+        return 0;
+#if ((__MAC_OS_X_VERSION_MIN_REQUIRED+0) >= 101200) /* Sierra */
+    if ((intptr_t)clock_getres != 0)
+        return (clock_getres((clockid_t)clock, res) == 0) ? base : 0;
+#endif /* ((__MAC_OS_X_VERSION_MIN_REQUIRED+0) >= 101200) */
+    res->tv_sec = 0;
+    res->tv_nsec = 1000L;
+    if (clock == CLOCK_MONOTONIC)
+    {
+        mach_timebase_info_data_t timebase = mach_timebase();
+        res->tv_nsec = (long)(timebase.numer / timebase.denom);
+        if (res->tv_nsec == 0)
+            res->tv_nsec = 1;
+    }
     return base;
 }
 
@@ -82,7 +220,6 @@ static inline int timespec_get(struct timespec* ts, int base)
 
 #include <assert.h>
 #include <time.h>
-#include <c11/stdatomic.h>
 
 #define WIN32_LEAN_AND_MEAN  1
 #include <windows.h>
@@ -95,6 +232,18 @@ static inline int timespec_get(struct timespec* ts, int base)
 #   define TIME_UTC 1
 #endif /* !defined(TIME_UTC) */
 
+#if !defined(TIME_MONOTONIC)
+#   define TIME_MONOTONIC 2
+#endif /* !defined(TIME_MONOTONIC) */
+
+#if !defined(TIME_ACTIVE)
+#   define TIME_ACTIVE 3
+#endif /* !defined(TIME_ACTIVE) */
+
+#if !defined(TIME_THREAD_ACTIVE)
+#   define TIME_THREAD_ACTIVE 4
+#endif /* !defined(TIME_THREAD_ACTIVE) */
+
 #if !defined(_TIMESPEC_DEFINED)
 
 struct timespec
@@ -111,7 +260,105 @@ struct timespec
 
 typedef void (WINAPI* GET_SYSTEM_TIME_AS_FILETIME)(LPFILETIME);
 
-static inline int timespec_get(struct timespec* ts, int base)
+#endif /* defined(__APPLE__) */
+
+#endif /* defined(HAVE_TIME_H_WORKAROUND) */
+
+/*
+ *  The time bases of C23 (and timespec_getres) where the C
+ *  library's timespec_get only knows TIME_UTC. The replacements
+ *  live in c11/time.c.
+ */
+
+#if defined(HAVE_TIME_H) && !defined(TIME_THREAD_ACTIVE)
+#   if !defined(TIME_MONOTONIC)
+#       define TIME_MONOTONIC 2
+#   endif /* !defined(TIME_MONOTONIC) */
+#   if !defined(TIME_ACTIVE)
+#       define TIME_ACTIVE 3
+#   endif /* !defined(TIME_ACTIVE) */
+#   define TIME_THREAD_ACTIVE 4
+#   define HAVE_TIMESPEC_GET_WORKAROUND 1
+int timespec_get_workaround(struct timespec* ts, int base);
+int timespec_getres_workaround(struct timespec* res, int base);
+#   undef timespec_get
+#   define timespec_get(ts, base) timespec_get_workaround((ts), (base))
+#   undef timespec_getres
+#   define timespec_getres(res, base) \
+        timespec_getres_workaround((res), (base))
+#endif /* defined(HAVE_TIME_H) ... */
+
+/*
+ *  Windows clocks, used by the workaround above as well as by the
+ *  replacements in c11/time.c.
+ */
+
+#if defined(_WIN32) && (defined(HAVE_TIME_H_WORKAROUND) \
+    || defined(HAVE_TIMESPEC_GET_WORKAROUND))
+
+#include <c11/stdatomic.h>
+
+#define WIN32_LEAN_AND_MEAN  1
+#include <windows.h>
+
+/*
+ *  TIME_MONOTONIC is the performance counter, its frequency is
+ *  fixed at boot.
+ */
+
+static inline __int64 performance_frequency(void)
+{
+    static volatile atomic_llong frequency = 0;
+    __int64 freq = atomic_load(&frequency);
+    if (freq == 0)
+    {
+        LARGE_INTEGER li = { 0 };
+        QueryPerformanceFrequency(&li);
+        freq = li.QuadPart;
+        atomic_store(&frequency, freq);
+    }
+    return freq;
+}
+
+static inline int timespec_get_monotonic(struct timespec* ts)
+{
+    __int64 freq = performance_frequency();
+    LARGE_INTEGER count = { 0 };
+    QueryPerformanceCounter(&count);
+    ts->tv_sec = (time_t)(count.QuadPart / freq);
+    ts->tv_nsec = (long)((count.QuadPart % freq) * 1000000000LL / freq);
+    return TIME_MONOTONIC;
+}
+
+/*
+ *  TIME_ACTIVE and TIME_THREAD_ACTIVE add up kernel and user
+ *  time (in 100 ns units), which Windows only updates on clock
+ *  interrupts.
+ */
+
+static inline int timespec_get_active(struct timespec* ts, int base)
+{
+    FILETIME creation, exit, kernel, user;
+    BOOL ok = (base == TIME_ACTIVE)
+        ? GetProcessTimes(GetCurrentProcess(), &creation, &exit
+            , &kernel, &user)
+        : GetThreadTimes(GetCurrentThread(), &creation, &exit
+            , &kernel, &user);
+    if (!ok)
+        return 0;
+    ULONGLONG ticks = ((((ULONGLONG)kernel.dwHighDateTime) << 32)
+        | kernel.dwLowDateTime) + ((((ULONGLONG)user.dwHighDateTime) << 32)
+        | user.dwLowDateTime);
+    ts->tv_sec = (time_t)(ticks / 10000000ULL);
+    ts->tv_nsec = (long)(ticks % 10000000ULL) * 100L;
+    return base;
+}
+
+#endif /* defined(_WIN32) ... */
+
+#if defined(_WIN32) && defined(HAVE_TIME_H_WORKAROUND)
+
+static inline intptr_t get_system_time_proc(void)
 {
     static volatile atomic_intptr_t get_system_time_as_filetime = 0;
     intptr_t proc = atomic_load(&get_system_time_as_filetime);
@@ -129,10 +376,19 @@ static inline int timespec_get(struct timespec* ts, int base)
         }
         atomic_store(&get_system_time_as_filetime, proc);
     }
+    return proc;
+}
+
+static inline int timespec_get(struct timespec* ts, int base)
+{
+    if (base == TIME_MONOTONIC)
+        return timespec_get_monotonic(ts);
+    if (base == TIME_ACTIVE || base == TIME_THREAD_ACTIVE)
+        return timespec_get_active(ts, base);
     if (base != TIME_UTC)
         return 0;
     FILETIME ft = { 0 };
-    ((GET_SYSTEM_TIME_AS_FILETIME)proc)(&ft);
+    ((GET_SYSTEM_TIME_AS_FILETIME)get_system_time_proc())(&ft);
     LARGE_INTEGER li = { 0 };
     li.LowPart = ft.dwLowDateTime;
     li.HighPart = (LONG)ft.dwHighDateTime;
@@ -142,9 +398,41 @@ static inline int timespec_get(struct timespec* ts, int base)
     return base;
 }
 
-#endif /* defined(__APPLE__) */
+/*
+ *  GetSystemTimeAsFileTime (before Windows 8) and the CPU times
+ *  advance once per clock interrupt, usually 15.6 ms.
+ */
 
-#endif /* defined(HAVE_TIME_H_WORKAROUND) */
+static inline int timespec_getres(struct timespec* res, int base)
+{
+    long long nsec = 0;
+    if (base == TIME_MONOTONIC)
+    {
+        nsec = 1000000000LL / performance_frequency();
+    }
+    else if (base == TIME_UTC && GetProcAddress(GetModuleHandleW(
+        L"kernel32.dll"), "GetSystemTimePreciseAsFileTime"))
+    {
+        nsec = 100;
+    }
+    else if (base == TIME_UTC || base == TIME_ACTIVE
+        || base == TIME_THREAD_ACTIVE)
+    {
+        DWORD adjustment = 0, increment = 0;
+        BOOL disabled = FALSE;
+        GetSystemTimeAdjustment(&adjustment, &increment, &disabled);
+        nsec = increment * 100LL;
+    }
+    else
+    {
+        return 0;
+    }
+    res->tv_sec = (time_t)(nsec / 1000000000LL);
+    res->tv_nsec = (nsec > 0) ? (long)(nsec % 1000000000LL) : 1L;
+    return base;
+}
+
+#endif /* defined(_WIN32) && defined(HAVE_TIME_H_WORKAROUND) */
 
 #undef HAVE_TIME_H_WORKAROUND
 
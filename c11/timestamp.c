@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include <c11/timestamp.h>
+
+#if defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN  1
+#   include <windows.h>
+#elif defined(__APPLE__)
+#   include <Availability.h>
+#endif /* defined(_WIN32) */
+
+#if defined(HAVE_TIMESTAMP_CYCLES) && !defined(_MSC_VER)
+#   include <cpuid.h>
+#endif /* defined(HAVE_TIMESTAMP_CYCLES) ... */
+
+struct timestamp_clock g_timestamp_clock = { 0, 0, 0 };
+
+static once_flag g_timestamp_once = ONCE_FLAG_INIT;
+
+static uint64_t monotonic_nsec(void)
+{
+    struct timespec ts = { 0 };
+    timespec_get(&ts, TIME_MONOTONIC);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+#if defined(HAVE_TIMESTAMP_CYCLES)
+
+/*
+ *  CPUID leaf 0x80000007, EDX bit 8: the TSC ticks at a constant
+ *  rate in all P-, C- and T-states. Anything older isn't a clock.
+ *  It says nothing about the counters of different sockets being
+ *  in sync, timestamp_now copes with one that is behind.
+ */
+
+static int has_invariant_tsc(void)
+{
+    unsigned int regs[4] = { 0 };
+#if defined(_MSC_VER)
+    __cpuid((int*)regs, 0x80000000);
+    if (regs[0] < 0x80000007)
+        return 0;
+    __cpuid((int*)regs, 0x80000007);
+#else
+    if (__get_cpuid_max(0x80000000, NULL) < 0x80000007)
+        return 0;
+    __get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif /* defined(_MSC_VER) */
+    return (regs[3] >> 8) & 1;
+}
+
+/*
+ *  Pairs a clock reading with the cycle count in the middle of
+ *  it, which halves the error of a preemption in between.
+ */
+
+static void sample(uint64_t* cycles, uint64_t* nsec)
+{
+    uint64_t before = timestamp_cycles();
+    *nsec = monotonic_nsec();
+    uint64_t after = timestamp_cycles();
+    *cycles = before + (after - before) / 2;
+}
+
+static void calibrate(void)
+{
+    if (!has_invariant_tsc())
+        return;
+    uint64_t cycles0 = 0, nsec0 = 0, cycles1 = 0, nsec1 = 0;
+    sample(&cycles0, &nsec0);
+    do
+    {
+        sample(&cycles1, &nsec1);
+    }
+    while (nsec1 - nsec0 < TIMESTAMP_CALIBRATION_MSEC * 1000000ULL);
+    if (cycles1 <= cycles0)
+        return;
+    uint64_t delta = nsec1 - nsec0;
+    uint64_t mult = (uint64_t)(((double)delta * 4294967296.0)
+        / (double)(cycles1 - cycles0));
+    g_timestamp_clock.cycles = cycles1;
+    g_timestamp_clock.nsec = nsec1;
+    atomic_store_explicit(&g_timestamp_clock.mult, mult
+        , memory_order_release);
+}
+
+#else
+
+static void calibrate(void)
+{
+}
+
+#endif /* defined(HAVE_TIMESTAMP_CYCLES) */
+
+int timestamp_init(void)
+{
+    call_once(&g_timestamp_once, calibrate);
+    if (atomic_load_explicit(&g_timestamp_clock.mult
+        , memory_order_acquire))
+        return thrd_success;
+    return thrd_error;
+}
+
+uint64_t timestamp_now_slow(void)
+{
+    if (timestamp_init() == thrd_success)
+        return timestamp_now();
+    return monotonic_nsec();
+}
+
+uint64_t timestamp_coarse(void)
+{
+#if defined(CLOCK_MONOTONIC_COARSE)
+    struct timespec ts = { 0 };
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#elif defined(__APPLE__) && ((__MAC_OS_X_VERSION_MIN_REQUIRED+0) >= 101200)
+    return clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW_APPROX);
+#elif defined(_WIN32)
+    ULONGLONG ticks = 0;
+    QueryUnbiasedInterruptTime(&ticks);
+    return (uint64_t)ticks * 100;
+#else
+    return monotonic_nsec();
+#endif /* defined(CLOCK_MONOTONIC_COARSE) */
+}
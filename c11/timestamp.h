@@ -0,0 +1,123 @@
+#ifndef __TIMESTAMP_H__
+#define __TIMESTAMP_H__
+
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <c11/_cdefs.h>
+#include <stdint.h>
+#include <c11/stdatomic.h>
+#include <c11/threads.h>
+#include <c11/time.h>
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#endif /* defined(_MSC_VER) */
+
+/*
+ *  Timestamps (non-standard)
+ *
+ *  Nanosecond timestamps for measuring intervals, cheaper than
+ *  timespec_get. Only differences between timestamps of the same
+ *  kind mean anything.
+ *
+ *  timestamp_coarse reads a clock that advances with the timer
+ *  interrupt (CLOCK_MONOTONIC_COARSE on Linux), about 1 to 16 ms.
+ *
+ *  timestamp_now reads the cycle counter and converts it with a
+ *  fixed-point multiply, the factor is calibrated against
+ *  TIME_MONOTONIC once. Without an invariant TSC it falls back
+ *  to timespec_get(TIME_MONOTONIC). Over time it drifts from
+ *  TIME_MONOTONIC by the calibration error (a few ppm). On a core
+ *  whose counter lags behind the calibrating one, timestamps taken
+ *  right after the calibration are clamped to its time.
+ *
+ *  timestamp_init calibrates up front (instead of on the first
+ *  call) and returns thrd_success if the cycle counter is used.
+ */
+
+#if defined(_M_X64) || defined(_M_IX86) \
+    || defined(__x86_64__) || defined(__i386__)
+#   define HAVE_TIMESTAMP_CYCLES 1
+#endif /* defined(_M_X64) ... */
+
+/*
+ *  Calibration period in milliseconds
+ */
+
+#if !defined(TIMESTAMP_CALIBRATION_MSEC)
+#   define TIMESTAMP_CALIBRATION_MSEC 10
+#endif /* !defined(TIMESTAMP_CALIBRATION_MSEC) */
+
+/*
+ *  Nanoseconds since the calibration are cycles * mult >> 32
+ *  (with a 128 bit product, so it doesn't overflow).
+ */
+
+struct timestamp_clock
+{
+    atomic_ullong mult;
+    uint64_t cycles;
+    uint64_t nsec;
+};
+
+extern struct timestamp_clock g_timestamp_clock;
+
+int timestamp_init(void);
+
+uint64_t timestamp_coarse(void);
+
+uint64_t timestamp_now_slow(void);
+
+#if defined(HAVE_TIMESTAMP_CYCLES)
+
+static inline uint64_t timestamp_cycles(void)
+{
+#if defined(_MSC_VER)
+    return __rdtsc();
+#else
+    return __builtin_ia32_rdtsc();
+#endif /* defined(_MSC_VER) */
+}
+
+static inline uint64_t timestamp_scale(uint64_t cycles, uint64_t mult)
+{
+#if defined(_M_X64)
+    uint64_t high = 0;
+    uint64_t low = _umul128(cycles, mult, &high);
+    return (high << 32) | (low >> 32);
+#elif defined(__SIZEOF_INT128__)
+    __extension__ unsigned __int128 product
+        = (unsigned __int128)cycles * mult;
+    return (uint64_t)(product >> 32);
+#else
+    return (cycles >> 32) * mult
+        + (((cycles & 0xffffffffULL) * mult) >> 32);
+#endif /* defined(_M_X64) */
+}
+
+#endif /* defined(HAVE_TIMESTAMP_CYCLES) */
+
+static inline uint64_t timestamp_now(void)
+{
+#if defined(HAVE_TIMESTAMP_CYCLES)
+    uint64_t mult = atomic_load_explicit(&g_timestamp_clock.mult
+        , memory_order_acquire);
+    if (mult)
+    {
+        int64_t cycles = (int64_t)(timestamp_cycles()
+            - g_timestamp_clock.cycles);
+        if (cycles < 0)
+            cycles = 0;
+        return g_timestamp_clock.nsec + timestamp_scale((uint64_t)cycles
+            , mult);
+    }
+#endif /* defined(HAVE_TIMESTAMP_CYCLES) */
+    return timestamp_now_slow();
+}
+
+#endif /* __TIMESTAMP_H__ */
@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include "test.h"
+
+#define THREADS 8
+#define ROUNDS 20000
+
+/*
+ *  Ping-pong on atomics of every size: each side waits for the
+ *  value the other one stores (values of the small types wrap).
+ */
+
+#define DEFINE_PING_PONG(name, atomic_type, type) \
+    static atomic_type g_##name; \
+    \
+    static void name##_await(type value) \
+    { \
+        type seen; \
+        while ((seen = atomic_load(&g_##name)) != value) \
+            atomic_wait(&g_##name, seen); \
+    } \
+    \
+    static int name##_pong(void* arg) \
+    { \
+        (void)arg; \
+        for (int i = 0; i < ROUNDS; i++) \
+        { \
+            name##_await((type)(2 * i + 1)); \
+            atomic_store(&g_##name, (type)(2 * i + 2)); \
+            atomic_notify_one(&g_##name); \
+        } \
+        return 0; \
+    } \
+    \
+    static void name##_ping(void) \
+    { \
+        thrd_t thread; \
+        test_start(&thread, 1, name##_pong, NULL); \
+        for (int i = 0; i < ROUNDS; i++) \
+        { \
+            atomic_store(&g_##name, (type)(2 * i + 1)); \
+            atomic_notify_one(&g_##name); \
+            name##_await((type)(2 * i + 2)); \
+        } \
+        CHECK(test_join(&thread, 1) == 0); \
+    }
+
+DEFINE_PING_PONG(uchar, atomic_uchar, unsigned char)
+DEFINE_PING_PONG(ushort, atomic_ushort, unsigned short)
+DEFINE_PING_PONG(uint, atomic_uint, unsigned int)
+DEFINE_PING_PONG(ullong, atomic_ullong, unsigned long long)
+
+/*
+ *  atomic_notify_all wakes every waiter
+ */
+
+static atomic_int g_flag;
+static atomic_int g_woken;
+
+static int flag_waiter(void* arg)
+{
+    (void)arg;
+    atomic_wait(&g_flag, 0);
+    CHECK(atomic_load(&g_flag) == 1);
+    atomic_fetch_add(&g_woken, 1);
+    return 0;
+}
+
+static void test_notify_all(void)
+{
+    thrd_t threads[THREADS];
+    test_start(threads, THREADS, flag_waiter, NULL);
+    test_sleep(50);
+    CHECK(atomic_load(&g_woken) == 0);
+    atomic_store(&g_flag, 1);
+    atomic_notify_all(&g_flag);
+    CHECK(test_join(threads, THREADS) == 0);
+    CHECK(atomic_load(&g_woken) == THREADS);
+}
+
+int main(void)
+{
+    uchar_ping();
+    ushort_ping();
+    uint_ping();
+    ullong_ping();
+    test_notify_all();
+
+    /*
+     *  The whole value is compared, not just the low 32 bits
+     */
+
+    atomic_ullong wide;
+    atomic_init(&wide, 1ULL << 32);
+    atomic_wait_explicit(&wide, 0, memory_order_acquire);
+    return EXIT_SUCCESS;
+}
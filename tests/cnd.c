@@ -0,0 +1,98 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include "test.h"
+
+#define WAITERS 8
+#define ROUNDS 500
+
+/*
+ *  Every round the main thread waits until all waiters are
+ *  blocked, then wakes them with a broadcast or one signal per
+ *  waiter, and waits until each of them has seen the round.
+ */
+
+static mtx_t g_mtx;
+static cnd_t g_wake;
+static cnd_t g_done;
+static int g_round;
+static int g_blocked;
+static int g_seen;
+
+static int waiter(void* arg)
+{
+    (void)arg;
+    CHECK(mtx_lock(&g_mtx) == thrd_success);
+    for (int round = 1; round <= ROUNDS; round++)
+    {
+        g_blocked++;
+        cnd_signal(&g_done);
+        while (g_round < round)
+            CHECK(cnd_wait(&g_wake, &g_mtx) == thrd_success);
+        g_seen++;
+        cnd_signal(&g_done);
+    }
+    mtx_unlock(&g_mtx);
+    return 0;
+}
+
+static void test_cnd(int type)
+{
+    thrd_t threads[WAITERS];
+    CHECK(mtx_init(&g_mtx, type) == thrd_success);
+    g_round = 0;
+    CHECK(cnd_init(&g_wake) == thrd_success);
+    CHECK(cnd_init(&g_done) == thrd_success);
+    test_start(threads, WAITERS, waiter, NULL);
+    CHECK(mtx_lock(&g_mtx) == thrd_success);
+    for (int round = 1; round <= ROUNDS; round++)
+    {
+        while (g_blocked < WAITERS)
+            CHECK(cnd_wait(&g_done, &g_mtx) == thrd_success);
+        g_blocked = 0;
+        g_seen = 0;
+        g_round = round;
+        if (round % 3 == 0)
+            cnd_broadcast(&g_wake);
+        else if (round % 3 == 1)
+            cnd_signal_n(&g_wake, WAITERS);
+        else
+        {
+            for (int i = 0; i < WAITERS; i++)
+                cnd_signal(&g_wake);
+        }
+        while (g_seen < WAITERS)
+            CHECK(cnd_wait(&g_done, &g_mtx) == thrd_success);
+    }
+    mtx_unlock(&g_mtx);
+    CHECK(test_join(threads, WAITERS) == 0);
+
+    CHECK(mtx_lock(&g_mtx) == thrd_success);
+    long long start = test_msec(TIME_MONOTONIC);
+    struct timespec deadline = test_deadline(TIME_MONOTONIC, 100);
+    CHECK(cnd_clockwait(&g_wake, &g_mtx, TIME_MONOTONIC, &deadline)
+        == thrd_timedout);
+    CHECK(test_msec(TIME_MONOTONIC) - start >= 95);
+    deadline = test_deadline(TIME_UTC, 20);
+    CHECK(cnd_timedwait(&g_wake, &g_mtx, &deadline) == thrd_timedout);
+    mtx_unlock(&g_mtx);
+
+    cnd_destroy(&g_done);
+    cnd_destroy(&g_wake);
+    mtx_destroy(&g_mtx);
+}
+
+int main(void)
+{
+    test_cnd(mtx_plain);
+    test_cnd(mtx_timed);
+    return EXIT_SUCCESS;
+}
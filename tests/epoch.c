@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include <c11/epoch.h>
+#include "test.h"
+
+#define READERS 6
+#define WRITERS 2
+#define ITERATIONS 100000
+
+/*
+ *  Writers replace the shared object and retire the old one,
+ *  readers must never see a freed object (the destructor
+ *  poisons it before freeing).
+ */
+
+struct object
+{
+    int value;
+    struct epoch_node node;
+};
+
+static epoch_t g_domain;
+static struct object* _Atomic g_shared;
+static atomic_long g_allocated;
+static atomic_long g_freed;
+static atomic_int g_stop;
+
+static void delete_object(struct epoch_node* node)
+{
+    struct object* object = (struct object*)((char*)node
+        - offsetof(struct object, node));
+    object->value = -1;
+    free(object);
+    atomic_fetch_add(&g_freed, 1);
+}
+
+static int writer(void* arg)
+{
+    (void)arg;
+    struct epoch_record* record = epoch_register(&g_domain);
+    CHECK(record != NULL);
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        struct object* object = malloc(sizeof(*object));
+        CHECK(object != NULL);
+        object->value = 42;
+        atomic_fetch_add(&g_allocated, 1);
+        struct object* old = atomic_exchange(&g_shared, object);
+        if (old)
+            epoch_retire(record, &old->node, delete_object);
+    }
+    return 0;
+}
+
+static int reader(void* arg)
+{
+    (void)arg;
+    struct epoch_record* record = epoch_register(&g_domain);
+    CHECK(record != NULL);
+    CHECK(epoch_register(&g_domain) == record);
+    while (!atomic_load(&g_stop))
+    {
+        epoch_enter(record);
+        epoch_enter(record);
+        struct object* object = atomic_load(&g_shared);
+        CHECK(object == NULL || object->value == 42);
+        epoch_exit(record);
+        epoch_exit(record);
+    }
+    return 0;
+}
+
+int main(void)
+{
+    thrd_t threads[READERS + WRITERS];
+    CHECK(epoch_init(&g_domain) == thrd_success);
+    test_start(threads, READERS, reader, NULL);
+    test_start(threads + READERS, WRITERS, writer, NULL);
+    CHECK(test_join(threads + READERS, WRITERS) == 0);
+    atomic_store(&g_stop, 1);
+    CHECK(test_join(threads, READERS) == 0);
+
+    /*
+     *  Records of exited threads are reused
+     */
+
+    test_start(threads, WRITERS, writer, NULL);
+    CHECK(test_join(threads, WRITERS) == 0);
+    struct epoch_record* record = epoch_register(&g_domain);
+    CHECK(record != NULL);
+    epoch_barrier(record);
+    free(atomic_load(&g_shared));
+    epoch_destroy(&g_domain);
+    CHECK(atomic_load(&g_freed) + 1 == atomic_load(&g_allocated));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include "test.h"
+
+#define THREADS 8
+#define ITERATIONS 100000
+
+static mtx_t g_mtx;
+static long g_counter;
+
+static int increment(void* arg)
+{
+    int recursive = (arg != NULL);
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        CHECK(mtx_lock(&g_mtx) == thrd_success);
+        if (recursive)
+            CHECK(mtx_lock(&g_mtx) == thrd_success);
+        g_counter++;
+        if (recursive)
+            mtx_unlock(&g_mtx);
+        mtx_unlock(&g_mtx);
+        if ((i % 64) == 0 && mtx_trylock(&g_mtx) == thrd_success)
+        {
+            g_counter++;
+            g_counter--;
+            mtx_unlock(&g_mtx);
+        }
+    }
+    return 0;
+}
+
+static int hold(void* arg)
+{
+    (void)arg;
+    CHECK(mtx_lock(&g_mtx) == thrd_success);
+    test_sleep(300);
+    mtx_unlock(&g_mtx);
+    return 0;
+}
+
+static void test_counter(int type)
+{
+    thrd_t threads[THREADS];
+    CHECK(mtx_init(&g_mtx, type) == thrd_success);
+    g_counter = 0;
+    test_start(threads, THREADS, increment
+        , (type & mtx_recursive) ? &g_mtx : NULL);
+    CHECK(test_join(threads, THREADS) == 0);
+    CHECK(g_counter == (long)THREADS * ITERATIONS);
+    mtx_destroy(&g_mtx);
+}
+
+static void test_timeout(int type)
+{
+    thrd_t holder;
+    CHECK(mtx_init(&g_mtx, type) == thrd_success);
+    test_start(&holder, 1, hold, NULL);
+    test_sleep(50);
+    CHECK(mtx_trylock(&g_mtx) == thrd_busy);
+    long long start = test_msec(TIME_MONOTONIC);
+    struct timespec deadline = test_deadline(TIME_MONOTONIC, 100);
+    CHECK(mtx_clocklock(&g_mtx, TIME_MONOTONIC, &deadline)
+        == thrd_timedout);
+    CHECK(test_msec(TIME_MONOTONIC) - start >= 95);
+    deadline = test_deadline(TIME_UTC, 20);
+    CHECK(mtx_timedlock(&g_mtx, &deadline) == thrd_timedout);
+    deadline = test_deadline(TIME_MONOTONIC, 5000);
+    CHECK(mtx_clocklock(&g_mtx, TIME_MONOTONIC, &deadline)
+        == thrd_success);
+    mtx_unlock(&g_mtx);
+    CHECK(test_join(&holder, 1) == 0);
+    mtx_destroy(&g_mtx);
+}
+
+int main(void)
+{
+    test_counter(mtx_plain);
+    test_counter(mtx_recursive);
+#if defined(HAVE_TIMEDLOCK)
+    CHECK(mtx_init(&g_mtx, mtx_plain | mtx_adaptive) == thrd_error);
+#else
+    test_counter(mtx_plain | mtx_adaptive);
+#endif /* defined(HAVE_TIMEDLOCK) */
+#if defined(HAVE_FUTEX)
+    test_counter(mtx_plain | mtx_fair);
+#else
+    CHECK(mtx_init(&g_mtx, mtx_plain | mtx_fair) == thrd_error);
+#endif /* defined(HAVE_FUTEX) */
+    test_timeout(mtx_timed);
+    test_timeout(mtx_timed | mtx_recursive);
+#if !defined(HAVE_TIMEDLOCK)
+    test_timeout(mtx_timed | mtx_adaptive);
+#endif /* !defined(HAVE_TIMEDLOCK) */
+#if defined(HAVE_FUTEX)
+    test_timeout(mtx_timed | mtx_fair);
+#endif /* defined(HAVE_FUTEX) */
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include "test.h"
+
+#define THREADS 16
+#define OBJECTS 1000
+
+/*
+ *  call_once: every initialization runs exactly once and is
+ *  visible to all callers when call_once returns.
+ */
+
+struct object
+{
+    once_flag once;
+    atomic_int runs;
+    int value;
+};
+
+static struct object g_objects[OBJECTS];
+static once_flag g_once = ONCE_FLAG_INIT;
+static atomic_int g_once_runs;
+static atomic_int g_go;
+
+static void init_global(void)
+{
+    atomic_fetch_add(&g_once_runs, 1);
+}
+
+static void init_object(void* arg)
+{
+    struct object* object = arg;
+    atomic_fetch_add(&object->runs, 1);
+    thrd_yield();
+    object->value = 42;
+}
+
+static int once_worker(void* arg)
+{
+    (void)arg;
+    while (!atomic_load(&g_go))
+        thrd_cpu_relax();
+    call_once(&g_once, init_global);
+    for (int i = 0; i < OBJECTS; i++)
+    {
+        call_once_ex(&g_objects[i].once, init_object, &g_objects[i]);
+        CHECK(g_objects[i].value == 42);
+    }
+    return 0;
+}
+
+static void test_once(void)
+{
+    thrd_t threads[THREADS];
+    for (int i = 0; i < OBJECTS; i++)
+    {
+        once_flag flag = ONCE_FLAG_INIT;
+        g_objects[i].once = flag;
+    }
+    test_start(threads, THREADS, once_worker, NULL);
+    atomic_store(&g_go, 1);
+    CHECK(test_join(threads, THREADS) == 0);
+    CHECK(atomic_load(&g_once_runs) == 1);
+    for (int i = 0; i < OBJECTS; i++)
+        CHECK(atomic_load(&g_objects[i].runs) == 1);
+}
+
+int main(void)
+{
+    test_once();
+    return EXIT_SUCCESS;
+}
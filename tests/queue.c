@@ -0,0 +1,208 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include <c11/queue.h>
+#include "test.h"
+
+#define PRODUCERS 3
+#define CONSUMERS 3
+#define ITEMS 200000
+
+/*
+ *  mpmc: the sum of all items consumed matches the sum of all
+ *  items produced, single and batched operations mixed.
+ */
+
+static mpmc_t g_mpmc;
+static atomic_llong g_sum;
+static atomic_int g_consumed;
+
+static int mpmc_producer(void* arg)
+{
+    intptr_t base = (intptr_t)arg * ITEMS;
+    intptr_t i = 0;
+    while (i < ITEMS)
+    {
+        if (i % 3 == 0)
+        {
+            void* items[7];
+            size_t count = 0;
+            while (count < 7 && i + (intptr_t)count < ITEMS)
+            {
+                items[count] = (void*)(base + i + (intptr_t)count + 1);
+                count++;
+            }
+            size_t pushed = mpmc_push_n(&g_mpmc, items, count);
+            i += (intptr_t)pushed;
+            if (pushed == 0)
+                thrd_yield();
+        }
+        else if (mpmc_push(&g_mpmc, (void*)(base + i + 1)) == thrd_success)
+            i++;
+        else
+            thrd_yield();
+    }
+    return 0;
+}
+
+static int mpmc_consumer(void* arg)
+{
+    (void)arg;
+    while (atomic_load(&g_consumed) < PRODUCERS * ITEMS)
+    {
+        void* items[5];
+        size_t count = mpmc_pop_n(&g_mpmc, items, 5);
+        for (size_t i = 0; i < count; i++)
+            atomic_fetch_add(&g_sum, (long long)(intptr_t)items[i]);
+        atomic_fetch_add(&g_consumed, (int)count);
+        if (count == 0)
+            thrd_yield();
+    }
+    return 0;
+}
+
+static void test_mpmc(void)
+{
+    thrd_t threads[PRODUCERS + CONSUMERS];
+    CHECK(mpmc_init(&g_mpmc, 100) == thrd_success);
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        CHECK(thrd_create(&threads[i], mpmc_producer, (void*)(intptr_t)i)
+            == thrd_success);
+    }
+    test_start(threads + PRODUCERS, CONSUMERS, mpmc_consumer, NULL);
+    CHECK(test_join(threads, PRODUCERS + CONSUMERS) == 0);
+    long long total = (long long)PRODUCERS * ITEMS;
+    CHECK(atomic_load(&g_sum) == total * (total + 1) / 2);
+    void* item = NULL;
+    CHECK(mpmc_pop(&g_mpmc, &item) == thrd_busy);
+    mpmc_destroy(&g_mpmc);
+}
+
+/*
+ *  mpsc: items of every producer arrive in order
+ */
+
+struct item
+{
+    int producer;
+    int sequence;
+    struct mpsc_node node;
+};
+
+static mpsc_t g_mpsc;
+
+static int mpsc_producer(void* arg)
+{
+    int producer = (int)(intptr_t)arg;
+    for (int i = 0; i < ITEMS; i++)
+    {
+        struct item* item = malloc(sizeof(*item));
+        CHECK(item != NULL);
+        item->producer = producer;
+        item->sequence = i;
+        mpsc_push(&g_mpsc, &item->node);
+    }
+    return 0;
+}
+
+static void test_mpsc(void)
+{
+    thrd_t threads[PRODUCERS];
+    int last[PRODUCERS];
+    CHECK(mpsc_init(&g_mpsc) == thrd_success);
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        last[i] = -1;
+        CHECK(thrd_create(&threads[i], mpsc_producer, (void*)(intptr_t)i)
+            == thrd_success);
+    }
+    for (long n = 0; n < (long)PRODUCERS * ITEMS; n++)
+    {
+        struct mpsc_node* node = NULL;
+        CHECK(mpsc_pop(&g_mpsc, &node) == thrd_success);
+        struct item* item = (struct item*)((char*)node
+            - offsetof(struct item, node));
+        CHECK(item->sequence == last[item->producer] + 1);
+        last[item->producer] = item->sequence;
+        free(item);
+    }
+    CHECK(test_join(threads, PRODUCERS) == 0);
+    struct mpsc_node* node = NULL;
+    CHECK(mpsc_trypop(&g_mpsc, &node) == thrd_busy);
+    struct timespec deadline = test_deadline(TIME_UTC, 20);
+    CHECK(mpsc_timedpop(&g_mpsc, &node, &deadline) == thrd_timedout);
+    mpsc_destroy(&g_mpsc);
+}
+
+/*
+ *  spsc: values arrive in order, single and zero-copy
+ *  operations mixed.
+ */
+
+static spsc_t g_spsc;
+
+static int spsc_producer(void* arg)
+{
+    (void)arg;
+    long i = 0;
+    while (i < ITEMS * 4)
+    {
+        if (i % 5 == 0)
+        {
+            size_t count = 13;
+            long* slots = spsc_reserve(&g_spsc, &count);
+            size_t k = 0;
+            for (; k < count && i < ITEMS * 4; k++, i++)
+                slots[k] = i;
+            spsc_commit(&g_spsc, k);
+        }
+        else if (spsc_push(&g_spsc, &i) == thrd_success)
+            i++;
+    }
+    return 0;
+}
+
+static int spsc_consumer(void* arg)
+{
+    (void)arg;
+    long expected = 0;
+    while (expected < ITEMS * 4)
+    {
+        size_t count = 7;
+        long* slots = spsc_peek(&g_spsc, &count);
+        for (size_t k = 0; k < count; k++)
+            CHECK(slots[k] == expected++);
+        spsc_release(&g_spsc, count);
+        long value = 0;
+        if (count == 0 && spsc_pop(&g_spsc, &value) == thrd_success)
+            CHECK(value == expected++);
+    }
+    return 0;
+}
+
+static void test_spsc(void)
+{
+    thrd_t threads[2];
+    CHECK(spsc_init(&g_spsc, 1000, sizeof(long)) == thrd_success);
+    test_start(threads, 1, spsc_consumer, NULL);
+    test_start(threads + 1, 1, spsc_producer, NULL);
+    CHECK(test_join(threads, 2) == 0);
+    spsc_destroy(&g_spsc);
+}
+
+int main(void)
+{
+    test_mpmc();
+    test_mpsc();
+    test_spsc();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include "test.h"
+
+#define READERS 6
+#define WRITERS 2
+#define ITERATIONS 20000
+
+/*
+ *  Writers keep both halves of the pair equal, readers must
+ *  never see them differ.
+ */
+
+static rwl_t g_rwl;
+static long g_first;
+static long g_second;
+
+static int reader(void* arg)
+{
+    (void)arg;
+    for (int i = 0; i < ITERATIONS * 4; i++)
+    {
+        CHECK(rwl_rdlock(&g_rwl) == thrd_success);
+        CHECK(g_first == g_second);
+        rwl_unlock(&g_rwl);
+    }
+    return 0;
+}
+
+static int writer(void* arg)
+{
+    (void)arg;
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        CHECK(rwl_wrlock(&g_rwl) == thrd_success);
+        g_first++;
+        g_second++;
+        rwl_unlock(&g_rwl);
+    }
+    return 0;
+}
+
+static void test_rwl(int type)
+{
+    thrd_t threads[READERS + WRITERS];
+    CHECK(rwl_init(&g_rwl, type) == thrd_success);
+    g_first = g_second = 0;
+    test_start(threads, READERS, reader, NULL);
+    test_start(threads + READERS, WRITERS, writer, NULL);
+    CHECK(test_join(threads, READERS + WRITERS) == 0);
+    CHECK(g_first == (long)WRITERS * ITERATIONS);
+
+    CHECK(rwl_tryrdlock(&g_rwl) == thrd_success);
+    CHECK(rwl_tryrdlock(&g_rwl) == thrd_success);
+    CHECK(rwl_trywrlock(&g_rwl) == thrd_busy);
+    struct timespec deadline = test_deadline(TIME_UTC, 20);
+    CHECK(rwl_timedwrlock(&g_rwl, &deadline) == thrd_timedout);
+    rwl_unlock(&g_rwl);
+    rwl_unlock(&g_rwl);
+
+    CHECK(rwl_trywrlock(&g_rwl) == thrd_success);
+    CHECK(rwl_tryrdlock(&g_rwl) == thrd_busy);
+    deadline = test_deadline(TIME_UTC, 20);
+    CHECK(rwl_timedrdlock(&g_rwl, &deadline) == thrd_timedout);
+    rwl_unlock(&g_rwl);
+    rwl_destroy(&g_rwl);
+}
+
+int main(void)
+{
+    test_rwl(rwl_plain);
+    test_rwl(rwl_scalable);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include <string.h>
+#include "test.h"
+
+#define THREADS 8
+#define ITERATIONS 100000
+
+/*
+ *  Counters of a contended mutex and a condition variable that
+ *  only times out, found through thrd_stats_foreach.
+ */
+
+static mtx_t g_mtx;
+static cnd_t g_cnd;
+static long g_counter;
+
+static int increment(void* arg)
+{
+    (void)arg;
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        CHECK(mtx_lock(&g_mtx) == thrd_success);
+        g_counter++;
+        mtx_unlock(&g_mtx);
+    }
+    return 0;
+}
+
+static int hold(void* arg)
+{
+    (void)arg;
+    CHECK(mtx_lock(&g_mtx) == thrd_success);
+    test_sleep(100);
+    mtx_unlock(&g_mtx);
+    return 0;
+}
+
+static unsigned long long load(const atomic_ullong* counter)
+{
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static unsigned long long total(const atomic_ullong* hist)
+{
+    unsigned long long sum = 0;
+    for (int i = 0; i < THRD_STATS_BUCKETS; i++)
+        sum += load(&hist[i]);
+    return sum;
+}
+
+static const struct thrd_stats* g_found[2];
+
+static void find(const struct thrd_stats* stats, void* arg)
+{
+    (void)arg;
+    if (stats->lock == &g_mtx)
+        g_found[0] = stats;
+    else if (stats->lock == &g_cnd)
+        g_found[1] = stats;
+}
+
+static void find_all(void)
+{
+    g_found[0] = NULL;
+    g_found[1] = NULL;
+    thrd_stats_foreach(find, NULL);
+}
+
+int main(void)
+{
+    thrd_t threads[THREADS];
+    CHECK(mtx_init(&g_mtx, mtx_timed) == thrd_success);
+    CHECK(cnd_init(&g_cnd) == thrd_success);
+    mtx_setname(&g_mtx, "counter");
+    cnd_setname(&g_cnd, "never");
+    test_start(threads, THREADS, increment, NULL);
+    CHECK(test_join(threads, THREADS) == 0);
+    CHECK(g_counter == (long)THREADS * ITERATIONS);
+
+    find_all();
+    const struct thrd_stats* stats = g_found[0];
+    CHECK(stats != NULL && stats->kind == thrd_stats_mtx);
+    CHECK(strcmp(stats->name, "counter") == 0);
+    CHECK(load(&stats->acquisitions) == (unsigned long long)THREADS
+        * ITERATIONS);
+    CHECK(load(&stats->contended) <= load(&stats->acquisitions));
+    CHECK(total(stats->wait_hist) == load(&stats->contended));
+    CHECK(total(stats->hold_hist) == load(&stats->contended));
+    CHECK(load(&stats->wait_max) <= load(&stats->wait_total));
+    CHECK(load(&stats->busy) == 0 && load(&stats->timeouts) == 0);
+
+    thrd_t holder;
+    test_start(&holder, 1, hold, NULL);
+    test_sleep(20);
+    CHECK(mtx_trylock(&g_mtx) == thrd_busy);
+    struct timespec deadline = test_deadline(TIME_UTC, 20);
+    CHECK(mtx_timedlock(&g_mtx, &deadline) == thrd_timedout);
+    CHECK(test_join(&holder, 1) == 0);
+    CHECK(load(&stats->busy) >= 1 && load(&stats->timeouts) == 1);
+
+    CHECK(mtx_lock(&g_mtx) == thrd_success);
+    deadline = test_deadline(TIME_UTC, 20);
+    CHECK(cnd_timedwait(&g_cnd, &g_mtx, &deadline) == thrd_timedout);
+    mtx_unlock(&g_mtx);
+    stats = g_found[1];
+    CHECK(stats != NULL && stats->kind == thrd_stats_cnd);
+    CHECK(load(&stats->acquisitions) == 1 && load(&stats->timeouts) == 1);
+
+    FILE* stream = tmpfile();
+    CHECK(stream != NULL);
+    thrd_stats_dump(stream);
+    CHECK(ftell(stream) > 0);
+    fclose(stream);
+
+    cnd_destroy(&g_cnd);
+    mtx_destroy(&g_mtx);
+    find_all();
+    CHECK(g_found[0] == NULL && g_found[1] == NULL);
+    return EXIT_SUCCESS;
+}
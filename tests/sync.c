@@ -0,0 +1,330 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include <string.h>
+#include "test.h"
+
+#define THREADS 8
+#define ITERATIONS 50000
+#define PHASES 2000
+#define FUTURES 2000
+#define CMTX_LOCKS 16
+
+/*
+ *  Semaphore with a single permit used as a mutex
+ */
+
+static sema_t g_sema;
+static atomic_int g_inside;
+static long g_counter;
+
+static int sema_worker(void* arg)
+{
+    (void)arg;
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        CHECK(sema_wait(&g_sema) == thrd_success);
+        CHECK(atomic_fetch_add(&g_inside, 1) == 0);
+        g_counter++;
+        atomic_fetch_sub(&g_inside, 1);
+        sema_post(&g_sema);
+    }
+    return 0;
+}
+
+static void test_sema(void)
+{
+    thrd_t threads[THREADS];
+    CHECK(sema_init(&g_sema, 1) == thrd_success);
+    test_start(threads, THREADS, sema_worker, NULL);
+    CHECK(test_join(threads, THREADS) == 0);
+    CHECK(g_counter == (long)THREADS * ITERATIONS);
+    CHECK(sema_trywait(&g_sema) == thrd_success);
+    CHECK(sema_trywait(&g_sema) == thrd_busy);
+    struct timespec deadline = test_deadline(TIME_UTC, 20);
+    CHECK(sema_timedwait(&g_sema, &deadline) == thrd_timedout);
+    sema_post_n(&g_sema, 3);
+    for (int i = 0; i < 3; i++)
+        CHECK(sema_trywait(&g_sema) == thrd_success);
+    CHECK(sema_trywait(&g_sema) == thrd_busy);
+    sema_destroy(&g_sema);
+}
+
+/*
+ *  A latch on the stack of the waiter, the last count_down must
+ *  not touch it after the waiter has returned.
+ */
+
+struct request
+{
+    latch_t done;
+    atomic_int results;
+};
+
+static struct request* _Atomic g_request;
+static atomic_int g_generation;
+static atomic_int g_stop;
+
+static int latch_worker(void* arg)
+{
+    (void)arg;
+    int seen = 0;
+    while (!atomic_load(&g_stop))
+    {
+        int generation = atomic_load(&g_generation);
+        if (generation == seen)
+        {
+            thrd_yield();
+            continue;
+        }
+        seen = generation;
+        struct request* request = atomic_load(&g_request);
+        atomic_fetch_add(&request->results, 1);
+        latch_count_down(&request->done, 1);
+    }
+    return 0;
+}
+
+static void test_latch(void)
+{
+    thrd_t threads[THREADS];
+    test_start(threads, THREADS, latch_worker, NULL);
+    for (int i = 0; i < PHASES; i++)
+    {
+        struct request request;
+        CHECK(latch_init(&request.done, THREADS) == thrd_success);
+        atomic_init(&request.results, 0);
+        atomic_store(&g_request, &request);
+        atomic_fetch_add(&g_generation, 1);
+        CHECK(latch_wait(&request.done) == thrd_success);
+        CHECK(atomic_load(&request.results) == THREADS);
+        latch_destroy(&request.done);
+    }
+    atomic_store(&g_stop, 1);
+    CHECK(test_join(threads, THREADS) == 0);
+
+    latch_t latch;
+    CHECK(latch_init(&latch, 2) == thrd_success);
+    struct timespec deadline = test_deadline(TIME_UTC, 20);
+    CHECK(latch_timedwait(&latch, &deadline) == thrd_timedout);
+    latch_count_down(&latch, 1);
+    CHECK(latch_trywait(&latch) == thrd_busy);
+    CHECK(latch_arrive_and_wait(&latch, 1) == thrd_success);
+    latch_destroy(&latch);
+}
+
+/*
+ *  The completion runs once per phase, after every thread has
+ *  arrived and before any of them leaves.
+ */
+
+static thrd_barrier_t g_barrier;
+static atomic_int g_arrived;
+static int g_phases;
+
+static void completion(void* arg)
+{
+    (void)arg;
+    CHECK(atomic_load(&g_arrived) == THREADS * (g_phases + 1));
+    g_phases++;
+}
+
+static int barrier_worker(void* arg)
+{
+    (void)arg;
+    for (int phase = 0; phase < PHASES; phase++)
+    {
+        atomic_fetch_add(&g_arrived, 1);
+        CHECK(thrd_barrier_wait(&g_barrier) == thrd_success);
+        CHECK(g_phases > phase);
+    }
+    return 0;
+}
+
+static void test_barrier(void)
+{
+    thrd_t threads[THREADS];
+    CHECK(thrd_barrier_init(&g_barrier, THREADS, completion, NULL)
+        == thrd_success);
+    test_start(threads, THREADS, barrier_worker, NULL);
+    CHECK(test_join(threads, THREADS) == 0);
+    CHECK(g_phases == PHASES);
+    thrd_barrier_destroy(&g_barrier);
+}
+
+/*
+ *  Futures set by one thread, read by others
+ */
+
+static future_t g_futures[FUTURES];
+static atomic_int g_callbacks;
+
+static void count_callback(void* value, void* arg)
+{
+    (void)value;
+    (void)arg;
+    atomic_fetch_add(&g_callbacks, 1);
+}
+
+static int future_producer(void* arg)
+{
+    (void)arg;
+    for (intptr_t i = 0; i < FUTURES; i++)
+        CHECK(future_set(&g_futures[i], (void*)(i + 1)) == thrd_success);
+    return 0;
+}
+
+static int future_consumer(void* arg)
+{
+    (void)arg;
+    for (intptr_t i = 0; i < FUTURES; i++)
+    {
+        void* value = NULL;
+        CHECK(future_get(&g_futures[i], &value) == thrd_success);
+        CHECK(value == (void*)(i + 1));
+    }
+    return 0;
+}
+
+static int future_chainer(void* arg)
+{
+    (void)arg;
+    for (int i = 0; i < FUTURES; i++)
+        future_then(&g_futures[i], count_callback, NULL);
+    return 0;
+}
+
+static void test_future(void)
+{
+    thrd_t threads[4];
+    for (int i = 0; i < FUTURES; i++)
+        CHECK(future_init(&g_futures[i]) == thrd_success);
+    test_start(threads, 2, future_consumer, NULL);
+    test_start(threads + 2, 1, future_chainer, NULL);
+    test_start(threads + 3, 1, future_producer, NULL);
+    CHECK(test_join(threads, 4) == 0);
+    CHECK(atomic_load(&g_callbacks) == FUTURES);
+    CHECK(future_set(&g_futures[0], NULL) == thrd_error);
+    for (int i = 0; i < FUTURES; i++)
+        future_destroy(&g_futures[i]);
+
+    future_t future;
+    CHECK(future_init(&future) == thrd_success);
+    struct timespec deadline = test_deadline(TIME_UTC, 20);
+    CHECK(future_timedget(&future, NULL, &deadline) == thrd_timedout);
+    CHECK(!future_ready(&future));
+    future_destroy(&future);
+}
+
+/*
+ *  The getter frees the future as soon as future_get returns,
+ *  future_set must not touch it after waking the getter.
+ */
+
+static future_t* _Atomic g_handoff;
+
+static int future_freer(void* arg)
+{
+    (void)arg;
+    for (int i = 0; i < FUTURES; i++)
+    {
+        future_t* future = NULL;
+        while ((future = atomic_exchange(&g_handoff, NULL)) == NULL)
+            thrd_yield();
+        void* value = NULL;
+        CHECK(future_get(future, &value) == thrd_success);
+        CHECK(value == future);
+        future_destroy(future);
+        memset(future, 0xff, sizeof(*future));
+        free(future);
+    }
+    return 0;
+}
+
+static void test_future_freed(void)
+{
+    thrd_t thread;
+    atomic_store(&g_callbacks, 0);
+    test_start(&thread, 1, future_freer, NULL);
+    for (int i = 0; i < FUTURES; i++)
+    {
+        future_t* future = malloc(sizeof(*future));
+        CHECK(future != NULL);
+        CHECK(future_init(future) == thrd_success);
+        CHECK(future_then(future, count_callback, NULL) == thrd_success);
+        atomic_store(&g_handoff, future);
+        while (atomic_load(&g_handoff) != NULL)
+            thrd_yield();
+        thrd_yield();
+        CHECK(future_set(future, future) == thrd_success);
+    }
+    CHECK(test_join(&thread, 1) == 0);
+    CHECK(atomic_load(&g_callbacks) == FUTURES);
+}
+
+/*
+ *  Compact mutexes hashed into the shared parking lot
+ */
+
+static cmtx_t g_cmtx[CMTX_LOCKS];
+static long g_cmtx_counters[CMTX_LOCKS];
+
+static int cmtx_worker(void* arg)
+{
+    unsigned int random = (unsigned int)(uintptr_t)arg * 2654435761U;
+    for (int i = 0; i < ITERATIONS; i++)
+    {
+        random = random * 1103515245U + 12345U;
+        unsigned int k = (random >> 16) % CMTX_LOCKS;
+        CHECK(cmtx_lock(&g_cmtx[k]) == thrd_success);
+        g_cmtx_counters[k]++;
+        cmtx_unlock(&g_cmtx[k]);
+    }
+    return 0;
+}
+
+static void test_cmtx(void)
+{
+    thrd_t threads[THREADS];
+    for (int i = 0; i < CMTX_LOCKS; i++)
+        CHECK(cmtx_init(&g_cmtx[i]) == thrd_success);
+    for (int i = 0; i < THREADS; i++)
+    {
+        CHECK(thrd_create(&threads[i], cmtx_worker, (void*)(uintptr_t)i)
+            == thrd_success);
+    }
+    CHECK(test_join(threads, THREADS) == 0);
+    long sum = 0;
+    for (int i = 0; i < CMTX_LOCKS; i++)
+    {
+        sum += g_cmtx_counters[i];
+        CHECK(atomic_load(&g_cmtx[i].state) == 0);
+    }
+    CHECK(sum == (long)THREADS * ITERATIONS);
+
+    cmtx_t mtx = CMTX_INITIALIZER;
+    CHECK(cmtx_trylock(&mtx) == thrd_success);
+    CHECK(cmtx_trylock(&mtx) == thrd_busy);
+    struct timespec deadline = test_deadline(TIME_UTC, 20);
+    CHECK(cmtx_timedlock(&mtx, &deadline) == thrd_timedout);
+    cmtx_unlock(&mtx);
+}
+
+int main(void)
+{
+    test_sema();
+    test_latch();
+    test_barrier();
+    test_future();
+    test_future_freed();
+    test_cmtx();
+    return EXIT_SUCCESS;
+}
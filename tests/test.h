@@ -0,0 +1,76 @@
+#ifndef __TEST_H__
+#define __TEST_H__
+
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <c11/threads.h>
+
+/*
+ *  Stress tests: every check that fails ends the test with a
+ *  message, ctest only looks at the exit code.
+ */
+
+#define CHECK(cond) \
+    do \
+    { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n" \
+                , __FILE__, __LINE__, #cond); \
+            exit(EXIT_FAILURE); \
+        } \
+    } \
+    while (0)
+
+static inline struct timespec test_deadline(int base, long msec)
+{
+    struct timespec deadline = { 0 };
+    struct timespec timeout = { 0 };
+    timeout.tv_sec = msec / 1000;
+    timeout.tv_nsec = (msec % 1000) * 1000000L;
+    thrd_deadline(&deadline, base, &timeout);
+    return deadline;
+}
+
+static inline long long test_msec(int base)
+{
+    struct timespec now = { 0 };
+    timespec_get(&now, base);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000L;
+}
+
+static inline void test_sleep(long msec)
+{
+    struct timespec duration = { 0 };
+    duration.tv_sec = msec / 1000;
+    duration.tv_nsec = (msec % 1000) * 1000000L;
+    thrd_sleep(&duration, NULL);
+}
+
+static inline void test_start(thrd_t* threads, int count, thrd_start_t func
+    , void* arg)
+{
+    for (int i = 0; i < count; i++)
+        CHECK(thrd_create(&threads[i], func, arg) == thrd_success);
+}
+
+static inline int test_join(thrd_t* threads, int count)
+{
+    int failed = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int res = 0;
+        CHECK(thrd_join(threads[i], &res) == thrd_success);
+        failed |= res;
+    }
+    return failed;
+}
+
+#endif /* __TEST_H__ */
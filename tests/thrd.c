@@ -0,0 +1,135 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include <string.h>
+#include "test.h"
+
+#if defined(__linux__)
+#   include <sched.h>
+#endif /* defined(__linux__) */
+
+#define THREADS 64
+#define STACK_SIZE (4 * 1024 * 1024)
+
+/*
+ *  thrd_create_ex: the result, the name and the stack size
+ *  arrive in the new thread. Pinning is checked on Linux, the
+ *  other platforms have to refuse CPU 64.
+ */
+
+static atomic_int g_finished;
+
+static int result(void* arg)
+{
+    atomic_fetch_add(&g_finished, 1);
+    return (int)(intptr_t)arg;
+}
+
+static int named(void* arg)
+{
+    (void)arg;
+#if defined(__linux__)
+    char name[16] = { 0 };
+    CHECK(pthread_getname_np(pthread_self(), name, sizeof(name)) == 0);
+    CHECK(strcmp(name, "c11-test-worker") == 0);
+#endif /* defined(__linux__) */
+    return 0;
+}
+
+static int deep(void* arg)
+{
+    (void)arg;
+    volatile char buffer[STACK_SIZE / 2];
+    memset((char*)buffer, 1, sizeof(buffer));
+#if defined(__linux__)
+    pthread_attr_t attr;
+    size_t size = 0;
+    CHECK(pthread_getattr_np(pthread_self(), &attr) == 0);
+    CHECK(pthread_attr_getstacksize(&attr, &size) == 0);
+    pthread_attr_destroy(&attr);
+    CHECK(size >= STACK_SIZE);
+#endif /* defined(__linux__) */
+    return buffer[0] - 1;
+}
+
+#if defined(__linux__)
+
+static int pinned(void* arg)
+{
+    CHECK(sched_getcpu() == (int)(intptr_t)arg);
+    return 0;
+}
+
+#endif /* defined(__linux__) */
+
+int main(void)
+{
+    thrd_t threads[THREADS];
+    for (intptr_t i = 0; i < THREADS; i++)
+    {
+        CHECK(thrd_create_ex(&threads[i], result, (void*)i, NULL)
+            == thrd_success);
+    }
+    for (int i = 0; i < THREADS; i++)
+    {
+        int res = -1;
+        CHECK(thrd_join(threads[i], &res) == thrd_success);
+        CHECK(res == i);
+    }
+
+    thrd_attr_t attr;
+    thrd_attr_init(&attr);
+    attr.name = "c11-test-worker-with-a-long-name";
+    CHECK(thrd_create_ex(&threads[0], named, NULL, &attr) == thrd_success);
+    CHECK(test_join(threads, 1) == 0);
+
+    thrd_attr_init(&attr);
+    attr.stack_size = STACK_SIZE;
+    attr.guard_size = 64 * 1024;
+    CHECK(thrd_create_ex(&threads[0], deep, NULL, &attr) == thrd_success);
+    CHECK(test_join(threads, 1) == 0);
+
+    thrd_attr_init(&attr);
+    attr.policy = -1;
+    CHECK(thrd_create_ex(&threads[0], result, NULL, &attr) == thrd_error);
+
+#if defined(__linux__)
+    cpu_set_t cpus;
+    CHECK(sched_getaffinity(0, sizeof(cpus), &cpus) == 0);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &cpus))
+            continue;
+        thrd_attr_init(&attr);
+        thrd_attr_setcpu(&attr, (unsigned int)cpu);
+        CHECK(thrd_create_ex(&threads[0], pinned, (void*)(intptr_t)cpu
+            , &attr) == thrd_success);
+        CHECK(test_join(threads, 1) == 0);
+    }
+#else
+    thrd_attr_init(&attr);
+    thrd_attr_setcpu(&attr, 64);
+    CHECK(thrd_create_ex(&threads[0], result, NULL, &attr) == thrd_error);
+#endif /* defined(__linux__) */
+
+    atomic_store(&g_finished, 0);
+    thrd_attr_init(&attr);
+    attr.name = "detached";
+    for (int i = 0; i < THREADS; i++)
+    {
+        CHECK(thrd_create_ex(&threads[i], result, NULL, &attr)
+            == thrd_success);
+        CHECK(thrd_detach(threads[i]) == thrd_success);
+    }
+    while (atomic_load(&g_finished) < THREADS)
+        thrd_yield();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include <c11/threadpool.h>
+#include "test.h"
+
+#define TASKS 200000
+#define RANGE 100000
+
+/*
+ *  Tasks submitted from outside and (recursively) from the
+ *  workers themselves, tpool_destroy waits for all of them.
+ */
+
+static tpool_t g_pool;
+static atomic_long g_done;
+
+static int leaf(void* arg)
+{
+    (void)arg;
+    atomic_fetch_add_explicit(&g_done, 1, memory_order_relaxed);
+    return 0;
+}
+
+static int spawn(void* arg)
+{
+    intptr_t count = (intptr_t)arg;
+    if (count > 1)
+    {
+        CHECK(tpool_submit(&g_pool, spawn, (void*)(count / 2))
+            == thrd_success);
+        CHECK(tpool_submit(&g_pool, spawn, (void*)(count - count / 2))
+            == thrd_success);
+    }
+    else
+        leaf(NULL);
+    return 0;
+}
+
+static void test_tasks(unsigned int workers)
+{
+    CHECK(tpool_init(&g_pool, workers) == thrd_success);
+    atomic_store(&g_done, 0);
+    for (int i = 0; i < TASKS; i++)
+        CHECK(tpool_submit(&g_pool, leaf, NULL) == thrd_success);
+    CHECK(tpool_submit(&g_pool, spawn, (void*)(intptr_t)TASKS)
+        == thrd_success);
+    tpool_destroy(&g_pool);
+    CHECK(atomic_load(&g_done) == 2L * TASKS);
+}
+
+/*
+ *  Parallel loops against their serial results
+ */
+
+static long long g_values[RANGE];
+static long long g_prefix[RANGE];
+
+static void fill(size_t begin, size_t end, void* arg)
+{
+    (void)arg;
+    for (size_t i = begin; i < end; i++)
+        g_values[i] = (long long)i;
+}
+
+static void sum(size_t begin, size_t end, void* partial, void* arg)
+{
+    (void)arg;
+    for (size_t i = begin; i < end; i++)
+        *(long long*)partial += g_values[i];
+}
+
+static void scan(size_t begin, size_t end, void* partial, void* arg)
+{
+    (void)arg;
+    for (size_t i = begin; i < end; i++)
+    {
+        *(long long*)partial += g_values[i];
+        g_prefix[i] = *(long long*)partial;
+    }
+}
+
+static void scan_only(size_t begin, size_t end, void* partial, void* arg)
+{
+    (void)arg;
+    long long prefix = *(long long*)partial;
+    for (size_t i = begin; i < end; i++)
+    {
+        prefix += g_values[i];
+        g_prefix[i] = prefix;
+    }
+}
+
+static void add(void* lhs, const void* rhs, void* arg)
+{
+    (void)arg;
+    *(long long*)lhs += *(const long long*)rhs;
+}
+
+static void test_loops(void)
+{
+    CHECK(tpool_init(&g_pool, 4) == thrd_success);
+    CHECK(parallel_for(&g_pool, 0, RANGE, 0, fill, NULL) == thrd_success);
+    long long total = 0;
+    CHECK(parallel_reduce(&g_pool, 0, RANGE, 0, &total, sizeof(total)
+        , sum, add, NULL) == thrd_success);
+    CHECK(total == (long long)RANGE * (RANGE - 1) / 2);
+    total = 0;
+    CHECK(parallel_scan(&g_pool, 0, RANGE, 1000, &total, sizeof(total)
+        , sum, scan, add, NULL) == thrd_success);
+    CHECK(total == (long long)RANGE * (RANGE - 1) / 2);
+    for (long long i = 0; i < RANGE; i++)
+        CHECK(g_prefix[i] == i * (i + 1) / 2);
+    tpool_destroy(&g_pool);
+}
+
+/*
+ *  total comes from reduce, also when there is just one chunk
+ *  and scan leaves its partial alone.
+ */
+
+static void test_scan_total(unsigned int workers, size_t grain)
+{
+    CHECK(tpool_init(&g_pool, workers) == thrd_success);
+    long long total = 0;
+    CHECK(parallel_scan(&g_pool, 0, RANGE, grain, &total, sizeof(total)
+        , sum, scan_only, add, NULL) == thrd_success);
+    CHECK(total == (long long)RANGE * (RANGE - 1) / 2);
+    for (long long i = 0; i < RANGE; i++)
+        CHECK(g_prefix[i] == i * (i + 1) / 2);
+    tpool_destroy(&g_pool);
+}
+
+int main(void)
+{
+    test_tasks(0);
+    test_tasks(1);
+    test_tasks(4);
+    test_loops();
+    test_scan_total(0, 0);
+    test_scan_total(4, RANGE);
+    test_scan_total(4, 1000);
+    return EXIT_SUCCESS;
+}
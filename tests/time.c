@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include <c11/timestamp.h>
+#include "test.h"
+
+static long long nsec(const struct timespec* ts)
+{
+    return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void test_bases(void)
+{
+    static const int bases[] =
+    {
+        TIME_UTC, TIME_MONOTONIC, TIME_ACTIVE, TIME_THREAD_ACTIVE
+    };
+    for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); i++)
+    {
+        struct timespec ts = { 0 };
+        struct timespec res = { 0 };
+        CHECK(timespec_get(&ts, bases[i]) == bases[i]);
+        CHECK(ts.tv_nsec >= 0 && ts.tv_nsec < 1000000000L);
+        CHECK(timespec_getres(&res, bases[i]) == bases[i]);
+        CHECK(nsec(&res) > 0);
+    }
+    struct timespec ts = { 0 };
+    CHECK(timespec_get(&ts, 0) == 0);
+}
+
+static void test_monotonic(void)
+{
+    struct timespec prev = { 0 };
+    CHECK(timespec_get(&prev, TIME_MONOTONIC) == TIME_MONOTONIC);
+    for (int i = 0; i < 100000; i++)
+    {
+        struct timespec now = { 0 };
+        timespec_get(&now, TIME_MONOTONIC);
+        CHECK(now.tv_nsec >= 0 && now.tv_nsec < 1000000000L);
+        CHECK(nsec(&now) >= nsec(&prev));
+        prev = now;
+    }
+    struct timespec deadline = test_deadline(TIME_MONOTONIC, 1500);
+    CHECK(nsec(&deadline) - nsec(&prev) >= 1500000000LL);
+    CHECK(deadline.tv_nsec >= 0 && deadline.tv_nsec < 1000000000L);
+}
+
+static void test_timestamp(void)
+{
+    timestamp_init();
+    long long monotonic = test_msec(TIME_MONOTONIC);
+    uint64_t start = timestamp_now();
+    uint64_t coarse = timestamp_coarse();
+    test_sleep(50);
+    uint64_t elapsed = timestamp_now() - start;
+    long long expected = test_msec(TIME_MONOTONIC) - monotonic;
+    CHECK(elapsed >= 45000000ULL);
+    CHECK(elapsed / 1000000ULL <= (uint64_t)expected + 5);
+    CHECK(timestamp_coarse() >= coarse);
+}
+
+static void test_sleep_precise(void)
+{
+    struct timespec duration = { 0, 2000000L };
+    for (int i = 0; i < 10; i++)
+    {
+        long long start = test_msec(TIME_MONOTONIC);
+        CHECK(thrd_sleep_precise(&duration) == thrd_success);
+        CHECK(test_msec(TIME_MONOTONIC) - start >= 1);
+    }
+    struct timespec deadline = test_deadline(TIME_MONOTONIC, 20);
+    CHECK(thrd_sleep_until(TIME_MONOTONIC, &deadline) == thrd_success);
+    struct timespec now = { 0 };
+    timespec_get(&now, TIME_MONOTONIC);
+    CHECK(nsec(&now) >= nsec(&deadline));
+}
+
+int main(void)
+{
+    test_bases();
+    test_monotonic();
+    test_timestamp();
+    test_sleep_precise();
+    return EXIT_SUCCESS;
+}
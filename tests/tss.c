@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2015-2021 Christoph Schreiber
+ *
+ *  Distributed under the Boost Software License, Version 1.0.
+ *  (http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE 1
+#endif /* defined(__linux__) ... */
+
+#include "test.h"
+
+#define THREADS 16
+
+/*
+ *  Thread-specific storage: destructors run at thread exit (also
+ *  for values set by destructors), a deleted key leaves nothing
+ *  behind for the next key.
+ */
+
+static tss_t g_key;
+static tss_t g_rearm;
+static atomic_int g_freed;
+static atomic_int g_rearmed;
+
+static void free_value(void* value)
+{
+    free(value);
+    atomic_fetch_add(&g_freed, 1);
+}
+
+static void rearm_once(void* value)
+{
+    if (value == (void*)1)
+    {
+        atomic_fetch_add(&g_rearmed, 1);
+        CHECK(tss_set(g_rearm, (void*)2) == thrd_success);
+    }
+}
+
+static int tss_worker(void* arg)
+{
+    (void)arg;
+    CHECK(tss_get(g_key) == NULL);
+    CHECK(tss_set(g_key, malloc(16)) == thrd_success);
+    CHECK(tss_get(g_key) != NULL);
+    CHECK(tss_set(g_rearm, (void*)1) == thrd_success);
+    return 0;
+}
+
+static int tss_user(void* arg)
+{
+    (void)arg;
+    tss_t key;
+    CHECK(tss_create(&key, NULL) == thrd_success);
+    for (int i = 0; i < 100000; i++)
+    {
+        CHECK(tss_set(key, &key) == thrd_success);
+        CHECK(tss_get(key) == &key);
+    }
+    tss_delete(key);
+    return 0;
+}
+
+static void test_tss(void)
+{
+    thrd_t threads[THREADS];
+    CHECK(tss_create(&g_key, free_value) == thrd_success);
+    CHECK(tss_create(&g_rearm, rearm_once) == thrd_success);
+    test_start(threads, THREADS, tss_worker, NULL);
+    CHECK(test_join(threads, THREADS) == 0);
+    CHECK(atomic_load(&g_freed) == THREADS);
+    CHECK(atomic_load(&g_rearmed) == THREADS);
+
+    test_start(threads, 4, tss_user, NULL);
+    for (int i = 0; i < 10000; i++)
+    {
+        tss_t key;
+        CHECK(tss_create(&key, free_value) == thrd_success);
+        CHECK(tss_get(key) == NULL);
+        CHECK(tss_set(key, &key) == thrd_success);
+        CHECK(tss_get(key) == &key);
+        tss_delete(key);
+    }
+    CHECK(test_join(threads, 4) == 0);
+    tss_delete(g_rearm);
+    tss_delete(g_key);
+}
+
+int main(void)
+{
+    test_tss();
+    return EXIT_SUCCESS;
+}